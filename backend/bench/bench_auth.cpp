@@ -0,0 +1,154 @@
+#include <benchmark/benchmark.h>
+#include "auth.h"
+#include <string>
+#include <vector>
+
+// The token store is process-wide. Each run's Setup empties it and issues
+// exactly range(0) tokens and Teardown empties it again, so the store-size
+// argument is the size the run actually measures. Setup and Teardown run
+// before and after the benchmark threads, so the fixtures need no locking.
+static std::vector<std::string> issued_tokens;
+
+static void fillTokenStore(const benchmark::State& state) {
+    Auth::clearTokenStore();
+    issued_tokens.clear();
+    size_t target = static_cast<size_t>(state.range(0));
+    for (size_t i = 0; i < target; ++i) {
+        issued_tokens.push_back(Auth::generateToken("bench-user-" + std::to_string(i)));
+    }
+}
+
+static void emptyTokenStore(const benchmark::State&) {
+    Auth::clearTokenStore();
+    issued_tokens.clear();
+}
+
+// Signed tokens are what multi-process mode issues; they never touch the store
+static void enableSignedTokens(const benchmark::State&) {
+    Auth::setTokenSecret("bench-token-secret-0123456789abcdef");
+    issued_tokens.clear();
+    for (int i = 0; i < 1024; ++i) {
+        issued_tokens.push_back(Auth::generateToken("bench-user-" + std::to_string(i)));
+    }
+}
+
+static void disableSignedTokens(const benchmark::State&) {
+    Auth::setTokenSecret("");
+    issued_tokens.clear();
+}
+
+static void BM_HashPassword(benchmark::State& state) {
+    std::string password(static_cast<size_t>(state.range(0)), 'p');
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Auth::hashPassword(password));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_HashPassword)->Arg(8)->Arg(64)->Arg(1024);
+
+static void BM_VerifyPassword(benchmark::State& state) {
+    std::string password = "correct horse battery staple";
+    std::string hash = Auth::hashPassword(password);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Auth::verifyPassword(password, hash));
+    }
+}
+BENCHMARK(BM_VerifyPassword);
+
+static void BM_GenerateToken(benchmark::State& state) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Auth::generateToken("bench-user"));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Every token issued here stays in the store until Teardown, so the store
+// starts each run at range(0) and grows by the tokens issued during it. The
+// iteration count is left to the library; a short minimum time keeps that
+// growth to a few tens of thousands of tokens.
+static int generate_token_registered = [] {
+    for (int64_t size : {int64_t(1) << 12, int64_t(1) << 16}) {
+        for (int threads : {1, 2, 4, 8}) {
+            benchmark::RegisterBenchmark("BM_GenerateToken", BM_GenerateToken)
+                ->Setup(fillTokenStore)
+                ->Teardown(emptyTokenStore)
+                ->Arg(size)
+                ->Threads(threads)
+                ->MinTime(0.05)
+                ->UseRealTime();
+        }
+    }
+    return 0;
+}();
+
+static void BM_VerifyToken(benchmark::State& state) {
+    const std::vector<std::string>& tokens = issued_tokens;
+    size_t i = static_cast<size_t>(state.thread_index());
+    std::string user_id;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Auth::verifyToken(tokens[i % tokens.size()], user_id));
+        i += 7919;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VerifyToken)
+    ->Setup(fillTokenStore)
+    ->Teardown(emptyTokenStore)
+    ->RangeMultiplier(16)->Range(1 << 8, 1 << 16)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+static void BM_VerifyTokenMiss(benchmark::State& state) {
+    std::string unknown(64, '0');
+    std::string user_id;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Auth::verifyToken(unknown, user_id));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VerifyTokenMiss)
+    ->Setup(fillTokenStore)
+    ->Teardown(emptyTokenStore)
+    ->RangeMultiplier(16)->Range(1 << 8, 1 << 16);
+
+static void BM_GenerateSignedToken(benchmark::State& state) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Auth::generateToken("bench-user"));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GenerateSignedToken)
+    ->Setup(enableSignedTokens)
+    ->Teardown(disableSignedTokens)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+static void BM_VerifySignedToken(benchmark::State& state) {
+    const std::vector<std::string>& tokens = issued_tokens;
+    size_t i = static_cast<size_t>(state.thread_index());
+    std::string user_id;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Auth::verifyToken(tokens[i % tokens.size()], user_id));
+        i += 7919;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VerifySignedToken)
+    ->Setup(enableSignedTokens)
+    ->Teardown(disableSignedTokens)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+// A forged signature costs the same HMAC as a valid one before it is rejected
+static void BM_VerifySignedTokenForged(benchmark::State& state) {
+    std::string forged = issued_tokens.front();
+    forged.back() = forged.back() == '0' ? '1' : '0';
+    std::string user_id;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Auth::verifyToken(forged, user_id));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VerifySignedTokenForged)
+    ->Setup(enableSignedTokens)
+    ->Teardown(disableSignedTokens);
@@ -0,0 +1,37 @@
+#include <benchmark/benchmark.h>
+#include "idempotency.h"
+#include <string>
+#include <vector>
+
+// A retry of a completed request: the path that should cost one hash lookup
+static void BM_IdempotencyReplay(benchmark::State& state) {
+    IdempotencyStore store(nullptr);
+    size_t key_count = static_cast<size_t>(state.range(0));
+    std::vector<std::string> keys(key_count);
+    bool replayed = false;
+    for (size_t i = 0; i < key_count; ++i) {
+        keys[i] = "65f1c0a2b3d4e5f6a7b8c911:transfer:" + std::to_string(i);
+        store.execute(keys[i], "fingerprint", []() {
+            return StoredResponse{200, R"({"success":true,"message":"Transfer completed successfully"})", "application/json"};
+        }, replayed);
+    }
+    
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(store.execute(keys[i++ % key_count], "fingerprint", []() {
+            return StoredResponse{};
+        }, replayed));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IdempotencyReplay)->RangeMultiplier(100)->Range(1, 100000);
+
+static void BM_IdempotencyFingerprint(benchmark::State& state) {
+    const std::string body = R"({"from_account":"65f1c0a2b3d4e5f6a7b8c911","to_account_number":"ACC1000000001",)"
+                             R"("amount":125.50,"description":"Rent share for March"})";
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(IdempotencyStore::fingerprint(body));
+    }
+    state.SetBytesProcessed(state.iterations() * body.size());
+}
+BENCHMARK(BM_IdempotencyFingerprint);
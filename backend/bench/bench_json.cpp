@@ -0,0 +1,82 @@
+#include <benchmark/benchmark.h>
+#include <crow/json.h>
+#include "routes.h"
+#include <string>
+#include <vector>
+
+static std::vector<Account> makeAccounts(size_t count) {
+    std::vector<Account> accounts(count);
+    for (size_t i = 0; i < count; ++i) {
+        accounts[i].id = "65f1c0a2b3d4e5f6a7b8c9" + std::to_string(10 + i % 90);
+        accounts[i].user_id = "65f1c0a2b3d4e5f6a7b8c900";
+        accounts[i].account_number = "ACC" + std::to_string(1000000000 + i);
+        accounts[i].account_type = i % 2 ? "savings" : "checking";
+        accounts[i].balance = 1234.56 + i;
+        accounts[i].status = "active";
+    }
+    return accounts;
+}
+
+static std::vector<Transaction> makeTransactions(size_t count) {
+    std::vector<Transaction> transactions(count);
+    for (size_t i = 0; i < count; ++i) {
+        transactions[i].id = "65f1c0a2b3d4e5f6a7b8d0" + std::to_string(10 + i % 90);
+        transactions[i].from_account = "65f1c0a2b3d4e5f6a7b8c911";
+        transactions[i].to_account = "65f1c0a2b3d4e5f6a7b8c912";
+        transactions[i].amount = 25.0 + i;
+        transactions[i].transaction_type = "transfer";
+        transactions[i].description = "Rent share for March";
+        transactions[i].timestamp = "2024-03-13T10:15:30Z";
+        transactions[i].status = "completed";
+    }
+    return transactions;
+}
+
+static void BM_ParseLoginRequest(benchmark::State& state) {
+    const std::string body = R"({"username":"testuser","password":"correct horse battery staple"})";
+    for (auto _ : state) {
+        auto json_data = crow::json::load(body);
+        std::string username = json_data["username"].s();
+        std::string password = json_data["password"].s();
+        benchmark::DoNotOptimize(username);
+        benchmark::DoNotOptimize(password);
+    }
+    state.SetBytesProcessed(state.iterations() * body.size());
+}
+BENCHMARK(BM_ParseLoginRequest);
+
+static void BM_ParseTransferRequest(benchmark::State& state) {
+    const std::string body = R"({"from_account":"65f1c0a2b3d4e5f6a7b8c911","to_account_number":"ACC1000000001",)"
+                             R"("amount":125.50,"description":"Rent share for March"})";
+    for (auto _ : state) {
+        auto json_data = crow::json::load(body);
+        std::string from_account = json_data["from_account"].s();
+        std::string to_account_number = json_data["to_account_number"].s();
+        double amount = json_data["amount"].d();
+        std::string description = json_data["description"].s();
+        benchmark::DoNotOptimize(from_account);
+        benchmark::DoNotOptimize(to_account_number);
+        benchmark::DoNotOptimize(amount);
+        benchmark::DoNotOptimize(description);
+    }
+    state.SetBytesProcessed(state.iterations() * body.size());
+}
+BENCHMARK(BM_ParseTransferRequest);
+
+static void BM_SerializeAccounts(benchmark::State& state) {
+    std::vector<Account> accounts = makeAccounts(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Routes::accountsToJson(accounts).dump());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SerializeAccounts)->RangeMultiplier(10)->Range(1, 1000);
+
+static void BM_SerializeTransactions(benchmark::State& state) {
+    std::vector<Transaction> transactions = makeTransactions(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Routes::transactionsToJson(transactions).dump());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SerializeTransactions)->RangeMultiplier(10)->Range(1, 10000);
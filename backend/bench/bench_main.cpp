@@ -0,0 +1,5 @@
+#include <benchmark/benchmark.h>
+
+// Run with --benchmark_format=json --benchmark_out=<file> to produce
+// results that bench/compare.py can diff across commits.
+BENCHMARK_MAIN();
@@ -0,0 +1,36 @@
+#include <benchmark/benchmark.h>
+#include "utils.h"
+#include <string>
+#include <vector>
+
+static void BM_GenerateRandomId(benchmark::State& state) {
+    int length = static_cast<int>(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Utils::generateRandomId(length));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GenerateRandomId)->Arg(10)->Arg(12)->Arg(32)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_GetCurrentTimestamp(benchmark::State& state) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Utils::getCurrentTimestamp());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetCurrentTimestamp);
+
+static void BM_IsValidEmail(benchmark::State& state) {
+    const std::vector<std::string> emails = {
+        "test@example.com",
+        "first.last+tag@sub.domain.co.uk",
+        "not-an-email",
+        "missing-tld@example",
+    };
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Utils::isValidEmail(emails[i++ % emails.size()]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IsValidEmail);
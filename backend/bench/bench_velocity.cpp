@@ -0,0 +1,59 @@
+#include <benchmark/benchmark.h>
+#include "velocity.h"
+#include <string>
+#include <vector>
+
+// Limits high enough that every transfer is admitted, so each iteration
+// pays for the full rule evaluation plus the counter update
+static std::vector<VelocityRule> permissiveRules() {
+    std::vector<VelocityRule> rules = VelocityEngine::defaultRules();
+    for (auto& rule : rules) {
+        rule.max_count = rule.max_count ? 1000000000LL : 0;
+        rule.max_amount = rule.max_amount ? 1e15 : 0.0;
+    }
+    return rules;
+}
+
+static VelocityEngine* shared_engine = nullptr;
+
+static void createEngine(const benchmark::State&) {
+    shared_engine = new VelocityEngine(permissiveRules());
+}
+
+static void destroyEngine(const benchmark::State&) {
+    delete shared_engine;
+    shared_engine = nullptr;
+}
+
+static void BM_VelocityAdmit(benchmark::State& state) {
+    size_t key_count = static_cast<size_t>(state.range(0));
+    std::vector<std::string> accounts(key_count);
+    std::vector<std::string> users(key_count);
+    for (size_t i = 0; i < key_count; ++i) {
+        accounts[i] = "65f1c0a2b3d4e5f6a7b8" + std::to_string(1000 + i);
+        users[i] = "65f1c0a2b3d4e5f6a7c0" + std::to_string(1000 + i);
+    }
+    
+    size_t i = static_cast<size_t>(state.thread_index()) * 7919;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(shared_engine->admit(accounts[i % key_count], users[i % key_count], 10.0));
+        ++i;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VelocityAdmit)
+    ->Setup(createEngine)
+    ->Teardown(destroyEngine)
+    ->RangeMultiplier(100)->Range(1, 100000)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+static void BM_VelocityReject(benchmark::State& state) {
+    // After the first ten admits every call trips ACCOUNT_BURST
+    VelocityEngine engine;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(engine.admit("account", "user", 10.0));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VelocityReject);
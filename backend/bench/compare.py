@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""Compare two banking_bench JSON result files and flag regressions.
+
+Usage:
+    ./banking_bench --benchmark_format=json --benchmark_out=base.json
+    ./banking_bench --benchmark_format=json --benchmark_out=new.json
+    python3 bench/compare.py base.json new.json --threshold 0.05
+
+Exits with status 1 when any benchmark got slower by more than the threshold.
+"""
+
+import argparse
+import json
+import sys
+
+UNIT_TO_NS = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+
+def load_results(path, metric):
+    with open(path) as f:
+        data = json.load(f)
+
+    results = {}
+    has_aggregates = any(b.get("run_type") == "aggregate" for b in data["benchmarks"])
+    for bench in data["benchmarks"]:
+        # With --benchmark_repetitions, compare the median of each benchmark
+        if has_aggregates:
+            if bench.get("aggregate_name") != "median":
+                continue
+            name = bench["run_name"]
+        else:
+            if bench.get("run_type") == "aggregate":
+                continue
+            name = bench["name"]
+        results[name] = bench[metric] * UNIT_TO_NS[bench.get("time_unit", "ns")]
+    return results
+
+
+def format_ns(value):
+    for unit, scale in (("s", 1e9), ("ms", 1e6), ("us", 1e3)):
+        if value >= scale:
+            return "%.2f %s" % (value / scale, unit)
+    return "%.1f ns" % value
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("baseline", help="benchmark JSON from the base commit")
+    parser.add_argument("contender", help="benchmark JSON from the new commit")
+    parser.add_argument("--threshold", type=float, default=0.05,
+                        help="relative slowdown that counts as a regression (default: 0.05)")
+    parser.add_argument("--metric", choices=("real_time", "cpu_time"), default="real_time",
+                        help="timing field to compare (default: real_time)")
+    args = parser.parse_args()
+
+    baseline = load_results(args.baseline, args.metric)
+    contender = load_results(args.contender, args.metric)
+
+    regressions = []
+    width = max((len(name) for name in baseline), default=10)
+    print("%-*s %12s %12s %9s" % (width, "Benchmark", "Baseline", "Contender", "Change"))
+    for name, base_time in baseline.items():
+        if name not in contender:
+            print("%-*s %12s %12s %9s" % (width, name, format_ns(base_time), "missing", ""))
+            continue
+        new_time = contender[name]
+        change = (new_time - base_time) / base_time if base_time > 0 else 0.0
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressions.append(name)
+        elif change < -args.threshold:
+            flag = "  improved"
+        print("%-*s %12s %12s %+8.1f%%%s" % (width, name, format_ns(base_time), format_ns(new_time),
+                                              change * 100, flag))
+
+    for name in contender:
+        if name not in baseline:
+            print("%-*s %12s %12s %9s" % (width, name, "new", format_ns(contender[name]), ""))
+
+    if regressions:
+        print("\n%d benchmark(s) regressed by more than %.0f%%" % (len(regressions), args.threshold * 100))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
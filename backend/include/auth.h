@@ -11,6 +11,13 @@ public:
     static std::string generateToken(const std::string& user_id);
     static bool verifyToken(const std::string& token, std::string& user_id);
     static std::string generateJWT(const std::string& user_id);
+    
+    // With a secret set, tokens are self-contained and HMAC-signed instead
+    // of kept in this process's token store, so any server process sharing
+    // the secret accepts them. Call before serving requests.
+    static void setTokenSecret(const std::string& secret);
+    // Drops every token in the store; lets benchmarks size it exactly
+    static void clearTokenStore();
     static bool verifyJWT(const std::string& token, std::string& user_id);
 };
 
@@ -0,0 +1,55 @@
+#ifndef BATCH_JOBS_H
+#define BATCH_JOBS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+// Interest and fee terms for one account_type
+struct AccrualRate {
+    double annual_rate;
+    double monthly_fee;
+    double fee_waiver_balance;
+};
+
+struct AccrualOptions {
+    std::string mongo_uri = "mongodb://localhost:27017";
+    std::string run_date;            // YYYY-MM-DD, defaults to today (UTC)
+    size_t batch_size = 10000;
+    size_t threads = 0;              // 0 = one per core
+    bool charge_fees = false;        // monthly fees are opt-in per run
+    bool restart = false;            // rescan from the start; stamped accounts are still skipped
+    std::map<std::string, AccrualRate> rates;
+};
+
+struct AccrualSummary {
+    size_t accounts = 0;
+    size_t updated = 0;
+    double interest_total = 0.0;
+    double fees_total = 0.0;
+    double seconds = 0.0;
+    bool resumed = false;
+    bool already_completed = false;
+};
+
+class BatchJobs {
+public:
+    static std::map<std::string, AccrualRate> defaultRates();
+    
+    // Daily interest (rounded to cents, half to even) and fee for n accounts.
+    // Rate terms are looked up by rate_index in the per-type tables. Written
+    // as straight-line arithmetic over contiguous arrays so it vectorizes.
+    static void accrueKernel(const double* balances, const uint8_t* rate_index,
+                             const double* daily_rates, const double* fees, const double* waiver_balances,
+                             double* interest_out, double* fee_out, size_t n);
+    
+    // Streams active accounts in _id order, applies one day of interest (and
+    // fees when enabled), and records matching transactions. Progress is
+    // checkpointed per batch in batch_checkpoints, so an interrupted run
+    // resumes where it stopped; every write is guarded by the run id, so a
+    // batch replayed after a crash is never applied twice.
+    static bool runAccrual(const AccrualOptions& options, AccrualSummary& summary);
+};
+
+#endif
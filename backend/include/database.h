@@ -2,10 +2,13 @@
 #define DATABASE_H
 
 #include <mongocxx/client.hpp>
+#include <mongocxx/pool.hpp>
 #include <mongocxx/database.hpp>
 #include <mongocxx/collection.hpp>
 #include <bsoncxx/json.hpp>
 #include <bsoncxx/builder/stream/document.hpp>
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -37,32 +40,81 @@ struct Transaction {
     std::string status;
 };
 
+// Per-account aggregate for one day ("2024-03-13") or month ("2024-03")
+struct AccountRollup {
+    std::string account_id;
+    std::string granularity;
+    std::string period;
+    long long count;
+    double debits;
+    double credits;
+    double closing_balance;
+};
+
+// Stored response for an Idempotency-Key, kept for 24 hours
+struct IdempotencyRecord {
+    std::string key;
+    std::string fingerprint;
+    int status_code;
+    std::string body;
+    std::string content_type;
+};
+
+// Outcome of claiming an Idempotency-Key; Unavailable means the database
+// could not be asked, which is not the same as getting the claim
+enum class ClaimResult { Claimed, Taken, Unavailable };
+
 class Database {
 private:
-    mongocxx::client client;
-    mongocxx::database db;
+    // mongocxx clients are not thread-safe; each call borrows one from the pool
+    std::unique_ptr<mongocxx::pool> pool;
+    
+protected:
+    // For in-memory subclasses that never open a MongoDB connection
+    struct Unconnected {};
+    explicit Database(Unconnected);
     
 public:
     Database();
+    virtual ~Database() = default;
     
     // User operations
-    bool createUser(const User& user);
-    User getUserByUsername(const std::string& username);
-    User getUserById(const std::string& id);
+    virtual bool createUser(const User& user);
+    virtual User getUserByUsername(const std::string& username);
+    virtual User getUserById(const std::string& id);
     
     // Account operations
-    bool createAccount(const Account& account);
-    std::vector<Account> getAccountsByUserId(const std::string& user_id);
-    Account getAccountById(const std::string& account_id);
-    Account getAccountByNumber(const std::string& account_number);
-    bool updateAccountBalance(const std::string& account_id, double new_balance);
+    virtual bool createAccount(const Account& account);
+    virtual std::vector<Account> getAccountsByUserId(const std::string& user_id);
+    virtual Account getAccountById(const std::string& account_id);
+    virtual Account getAccountByNumber(const std::string& account_number);
+    virtual bool updateAccountBalance(const std::string& account_id, double new_balance);
+    virtual void forEachAccount(const std::function<void(const Account&)>& callback);
     
     // Transaction operations
-    bool createTransaction(const Transaction& transaction);
-    std::vector<Transaction> getTransactionsByAccountId(const std::string& account_id);
+    // Sets transaction.id on success
+    virtual bool createTransaction(Transaction& transaction);
+    virtual std::vector<Transaction> getTransactionsByAccountId(const std::string& account_id);
+    virtual std::vector<Transaction> getTransactionsSince(const std::string& timestamp);
+    
+    // Rollup operations
+    virtual bool applyTransactionRollups(const Transaction& transaction, double from_balance, double to_balance);
+    virtual std::vector<AccountRollup> getAccountRollups(const std::string& account_id, const std::string& granularity);
+    virtual bool replaceAccountRollups(const std::string& account_id, const std::vector<AccountRollup>& rollups);
+    
+    // Idempotency operations. A claim is a pending record (status_code 0)
+    // that marks a key as being executed; claimIdempotencyKey returns Taken
+    // when another request holds the key or has already completed it.
+    // The owner renews its claims while the request runs; a claim that has
+    // not been renewed for a minute is treated as abandoned and taken over.
+    virtual ClaimResult claimIdempotencyKey(const std::string& key, const std::string& fingerprint);
+    virtual bool renewIdempotencyClaims(const std::vector<std::string>& keys);
+    virtual bool findIdempotencyRecord(const std::string& key, IdempotencyRecord& record);
+    virtual bool saveIdempotencyRecord(const IdempotencyRecord& record);
+    virtual bool releaseIdempotencyKey(const std::string& key);
     
     // Utility
-    std::string generateAccountNumber();
+    virtual std::string generateAccountNumber();
 };
 
 #endif
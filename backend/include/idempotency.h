@@ -0,0 +1,100 @@
+#ifndef IDEMPOTENCY_H
+#define IDEMPOTENCY_H
+
+#include "database.h"
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+struct StoredResponse {
+    int status = 0;
+    std::string body;
+    std::string content_type;
+    // Set by a handler on a rejection that may not hold on retry; like a
+    // 5xx it reaches waiting duplicates but is not kept
+    bool transient = false;
+    // Set on a completed response the store kept; only these are replays
+    bool stored = false;
+};
+
+// Remembers the response to each Idempotency-Key so retried requests are
+// answered without running the handler again.
+//
+// Keys live in a bounded, sharded in-memory table (LRU per shard, 24h TTL).
+// A duplicate that arrives while the first request is still running waits
+// briefly for its result instead of executing concurrently, and gets a 409
+// if the first request is still running after that. Keys this process has
+// not seen are claimed in MongoDB before the handler runs, so duplicates that
+// reach different server processes (or arrive after a restart) also run once;
+// completed responses are stored with the claim. A background thread renews
+// this process's claims while their handlers run, so only a claim whose
+// owner has died is ever taken over. If a completed response cannot be
+// saved, its claim stays held and renewed while the save is retried.
+class IdempotencyStore {
+private:
+    using Clock = std::chrono::steady_clock;
+    
+    struct Entry {
+        std::string fingerprint;
+        std::shared_future<StoredResponse> result;
+        bool completed;
+        Clock::time_point created_at;
+        std::list<std::string>::iterator lru_position;
+    };
+    
+    static constexpr size_t kShardCount = 32;
+    
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, Entry> entries;
+        std::list<std::string> lru;
+    };
+    
+    Database* db;
+    size_t shard_capacity;
+    std::chrono::seconds ttl;
+    Shard shards[kShardCount];
+    
+    // Keys this process has claimed in the database and is still executing,
+    // and completed responses whose save failed (their keys stay claimed)
+    std::mutex claims_mutex;
+    std::condition_variable claims_changed;
+    std::unordered_set<std::string> claimed_keys;
+    std::unordered_map<std::string, IdempotencyRecord> unsaved_records;
+    bool stopping = false;
+    std::thread renewer;
+    
+    Shard& shardFor(const std::string& key);
+    void evict(Shard& shard);
+    void finish(const std::string& key, const std::string& fingerprint, bool keep);
+    void holdClaim(const std::string& key);
+    void dropClaim(const std::string& key);
+    bool save(const IdempotencyRecord& record);
+    void renewClaims();
+    
+public:
+    // db may be null to keep keys in memory only
+    IdempotencyStore(Database* database, size_t capacity = 100000,
+                     std::chrono::seconds time_to_live = std::chrono::hours(24));
+    ~IdempotencyStore();
+    
+    // Stable digest of a request body, used to detect a key reused for a different request
+    static std::string fingerprint(const std::string& body);
+    
+    // Runs handler at most once per key and returns its response, or the
+    // stored response for a repeated key (replayed is set). Responses with a
+    // 5xx status or marked transient are handed to waiting duplicates but not
+    // kept, so a later retry runs the handler again. Answers 503 without
+    // running the handler when the key cannot be claimed in the database.
+    StoredResponse execute(const std::string& key, const std::string& fingerprint,
+                           const std::function<StoredResponse()>& handler, bool& replayed);
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef MEMORY_DATABASE_H
+#define MEMORY_DATABASE_H
+
+#include "database.h"
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// In-process stand-in for MongoDB, used to exercise Routes without a mongod
+// (load testing on a laptop or in CI). Data lives only as long as the object.
+class MemoryDatabase : public Database {
+private:
+    std::mutex mutex;
+    unsigned long long next_id = 1;
+    
+    std::unordered_map<std::string, User> users;
+    std::unordered_map<std::string, std::string> user_ids_by_username;
+    std::unordered_map<std::string, Account> accounts;
+    std::unordered_map<std::string, std::string> account_ids_by_number;
+    std::vector<Transaction> transactions;
+    std::unordered_map<std::string, std::vector<size_t>> transactions_by_account;
+    std::map<std::string, AccountRollup> rollups;
+    std::unordered_map<std::string, IdempotencyRecord> idempotency_records;
+    
+    std::string nextId();
+    
+public:
+    MemoryDatabase();
+    
+    bool createUser(const User& user) override;
+    User getUserByUsername(const std::string& username) override;
+    User getUserById(const std::string& id) override;
+    
+    bool createAccount(const Account& account) override;
+    std::vector<Account> getAccountsByUserId(const std::string& user_id) override;
+    Account getAccountById(const std::string& account_id) override;
+    Account getAccountByNumber(const std::string& account_number) override;
+    bool updateAccountBalance(const std::string& account_id, double new_balance) override;
+    void forEachAccount(const std::function<void(const Account&)>& callback) override;
+    
+    bool createTransaction(Transaction& transaction) override;
+    std::vector<Transaction> getTransactionsByAccountId(const std::string& account_id) override;
+    std::vector<Transaction> getTransactionsSince(const std::string& timestamp) override;
+    
+    bool applyTransactionRollups(const Transaction& transaction, double from_balance, double to_balance) override;
+    std::vector<AccountRollup> getAccountRollups(const std::string& account_id, const std::string& granularity) override;
+    bool replaceAccountRollups(const std::string& account_id, const std::vector<AccountRollup>& rollups) override;
+    
+    ClaimResult claimIdempotencyKey(const std::string& key, const std::string& fingerprint) override;
+    bool renewIdempotencyClaims(const std::vector<std::string>& keys) override;
+    bool findIdempotencyRecord(const std::string& key, IdempotencyRecord& record) override;
+    bool saveIdempotencyRecord(const IdempotencyRecord& record) override;
+    bool releaseIdempotencyKey(const std::string& key) override;
+};
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef ROLLUPS_H
+#define ROLLUPS_H
+
+#include "database.h"
+#include <string>
+#include <vector>
+
+class Rollups {
+public:
+    static bool isValidGranularity(const std::string& granularity);
+    
+    // Bucket key for an ISO-8601 timestamp: "2024-03-13" for day, "2024-03" for month
+    static std::string periodKey(const std::string& timestamp, const std::string& granularity);
+    
+    // Recomputes day and month rollups for one account from its full history.
+    // Closing balances are derived backwards from the account's current balance.
+    static std::vector<AccountRollup> compute(const std::string& account_id,
+                                              const std::vector<Transaction>& transactions,
+                                              double current_balance);
+};
+
+#endif
@@ -3,14 +3,43 @@
 
 #include <crow.h>
 #include "database.h"
+#include "idempotency.h"
+#include "server_stats.h"
+#include "velocity.h"
+#include <chrono>
+#include <functional>
+
+// Counts requests, 5xx responses, in-flight requests and latency into this
+// process's ServerStats slot (set slot before the app starts)
+struct RequestMetrics {
+    struct context {
+        std::chrono::steady_clock::time_point start;
+    };
+    
+    WorkerSlot* slot = nullptr;
+    
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+};
+
+using BankingApp = crow::App<crow::CORSHandler, RequestMetrics>;
 
 class Routes {
 private:
     Database* db;
+    VelocityEngine* velocity;
+    IdempotencyStore* idempotency;
+    ServerStats* stats;
+    
+    // Replays the stored response when the request repeats an Idempotency-Key
+    crow::response withIdempotency(const crow::request& req, const std::string& operation,
+                                   const std::function<crow::response()>& handler);
     
 public:
-    Routes(Database* database);
-    void setupRoutes(crow::SimpleApp& app);
+    // velocity, idempotency and stats may be null to run without those features
+    Routes(Database* database, VelocityEngine* velocity_engine = nullptr,
+           IdempotencyStore* idempotency_store = nullptr, ServerStats* server_stats = nullptr);
+    void setupRoutes(BankingApp& app);
     
     // Route handlers
     crow::response handleLogin(const crow::request& req);
@@ -20,6 +49,13 @@ public:
     crow::response handleGetTransactions(const std::string& account_id, const crow::request& req);
     crow::response handleCreateAccount(const crow::request& req);
     crow::response handleGetAccounts(const crow::request& req);
+    crow::response handleGetAccountSummary(const std::string& account_id, const crow::request& req);
+    crow::response handleHealth(const crow::request& req);
+    crow::response handleMetrics(const crow::request& req);
+    
+    // JSON serialization
+    static crow::json::wvalue accountsToJson(const std::vector<Account>& accounts);
+    static crow::json::wvalue transactionsToJson(const std::vector<Transaction>& transactions);
 };
 
 #endif
@@ -0,0 +1,86 @@
+#ifndef SERVER_STATS_H
+#define SERVER_STATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class WorkerState : uint32_t {
+    Free = 0,
+    Starting,
+    Ready,
+    Draining
+};
+
+// Counters for one server process. Slots live in memory shared by the
+// supervisor and all workers, so everything is a lock-free atomic.
+struct alignas(64) WorkerSlot {
+    std::atomic<uint32_t> state;
+    std::atomic<int32_t> pid;
+    std::atomic<int32_t> index;
+    std::atomic<int32_t> cpu;
+    std::atomic<uint32_t> generation;
+    std::atomic<int64_t> started_at;
+    std::atomic<uint64_t> requests;
+    std::atomic<uint64_t> errors;
+    std::atomic<uint64_t> in_flight;
+    std::atomic<uint64_t> latency_us;
+};
+
+struct WorkerSnapshot {
+    int index;
+    int pid;
+    int cpu;
+    unsigned generation;
+    WorkerState state;
+    int64_t uptime;
+    uint64_t requests;
+    uint64_t errors;
+    uint64_t in_flight;
+    uint64_t latency_us;
+};
+
+struct StatsSnapshot {
+    size_t configured_workers;
+    size_t ready_workers;
+    int64_t uptime;
+    uint64_t requests;       // includes workers that have since been replaced
+    uint64_t errors;
+    uint64_t in_flight;
+    uint64_t latency_us;
+    std::vector<WorkerSnapshot> workers;
+};
+
+// Per-worker request counters, aggregated for /api/health and /metrics.
+// In multi-process mode the table is created by the supervisor before it
+// forks, so every worker can read every other worker's slot.
+class ServerStats {
+private:
+    size_t slot_count;
+    size_t configured_workers;
+    int64_t started_at;
+    std::atomic<uint64_t> retired_requests;
+    std::atomic<uint64_t> retired_errors;
+    std::atomic<uint64_t> retired_latency_us;
+    
+    ServerStats(size_t slots, size_t workers);
+    
+public:
+    // Allocates the table in an anonymous shared mapping; with shared set it
+    // stays shared across fork(). Never freed: it lives as long as the process.
+    static ServerStats* create(size_t slots, size_t workers, bool shared);
+    
+    size_t capacity() const { return slot_count; }
+    WorkerSlot& slot(size_t i);
+    
+    // Claims a free slot for a new worker, or returns null if all are taken
+    WorkerSlot* acquire(int index, unsigned generation);
+    
+    // Folds a finished worker's counters into the totals and frees its slot
+    void retire(WorkerSlot& slot);
+    
+    StatsSnapshot snapshot();
+};
+
+#endif
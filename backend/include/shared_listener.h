@@ -0,0 +1,23 @@
+#ifndef SHARED_LISTENER_H
+#define SHARED_LISTENER_H
+
+// The server's listening port, shared by every worker process.
+//
+// Crow binds its acceptor internally without exposing socket options, so
+// SO_REUSEPORT is set by wrapping bind(2). The wrapper is defined in
+// shared_listener.cpp, which only banking_server links; no other binary
+// gets a replacement bind.
+class SharedListener {
+public:
+    // Makes every TCP socket bound by this process set SO_REUSEPORT first
+    static void enableReusePort();
+    
+    // Stops this process accepting connections on the sockets it listens
+    // on, while connections it already accepted keep working. Each listening
+    // socket is replaced in place by an idle one, so its descriptor stays
+    // valid for Crow to close later; the kernel sends new connections to
+    // the other workers from then on.
+    static void stopAccepting();
+};
+
+#endif
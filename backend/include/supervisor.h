@@ -0,0 +1,65 @@
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include "server_stats.h"
+#include <chrono>
+#include <functional>
+#include <signal.h>
+#include <sys/types.h>
+#include <vector>
+
+struct SupervisorOptions {
+    size_t workers = 1;
+    bool pin_cpus = true;
+    std::chrono::seconds ready_timeout{30};   // for a new worker to start listening
+    std::chrono::seconds stop_timeout{30};    // for a stopped worker to exit before SIGKILL
+};
+
+// Pre-fork process manager for the shared-nothing serving mode.
+//
+// Forks one worker process per configured slot and pins each to a CPU.
+// Workers share nothing but the listening port (bound with SO_REUSEPORT, so
+// the kernel spreads connections across them) and the ServerStats table.
+// Crashed workers are restarted. SIGHUP replaces workers one at a time,
+// stopping each old worker only once its replacement is listening;
+// SIGTERM/SIGINT stop all workers and return from run().
+//
+// The supervisor itself must stay single-threaded and must not touch
+// MongoDB, so every worker starts from a clean fork.
+class Supervisor {
+private:
+    struct Worker {
+        pid_t pid;
+        int index;
+        unsigned generation;
+        WorkerSlot* slot;
+        std::chrono::steady_clock::time_point started;
+    };
+    
+    SupervisorOptions options;
+    ServerStats* stats;
+    std::function<int(WorkerSlot&)> worker_main;
+    std::vector<int> cpus;
+    std::vector<Worker> workers;
+    sigset_t previous_mask;
+    bool stopping = false;
+    
+    bool spawn(int index, unsigned generation);
+    void reap();
+    bool waitUntilReady(pid_t pid);
+    void stopWorkers(const std::vector<pid_t>& pids);
+    void forget(pid_t pid);
+    void rollingRestart();
+    
+public:
+    // worker_main runs in each forked worker; its return value is the exit status
+    Supervisor(const SupervisorOptions& supervisor_options, ServerStats* server_stats,
+               std::function<int(WorkerSlot&)> worker);
+    
+    // CPUs this process may run on, in the order workers are pinned to them
+    static std::vector<int> availableCpus();
+    
+    int run();
+};
+
+#endif
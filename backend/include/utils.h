@@ -1,12 +1,15 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <cstdint>
 #include <string>
 #include <random>
 
 class Utils {
 public:
     static std::string getCurrentTimestamp();
+    static std::string formatTimestamp(int64_t epoch_seconds);
+    static int64_t parseTimestamp(const std::string& timestamp);
     static std::string generateRandomId(int length = 12);
     static bool isValidEmail(const std::string& email);
     static bool isValidAmount(double amount);
@@ -0,0 +1,136 @@
+#ifndef VELOCITY_H
+#define VELOCITY_H
+
+#include "database.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class VelocityScope { Account, User };
+enum class VelocityWindow { Minute, Hour, Day };
+
+// A limit on transfers out of one account or one user's accounts within a
+// sliding window. A zero limit is not checked.
+struct VelocityRule {
+    std::string reason_code;
+    VelocityScope scope;
+    VelocityWindow window;
+    long long max_count;
+    double max_amount;
+};
+
+struct VelocityDecision {
+    bool allowed = true;
+    std::string reason_code;
+    int64_t admitted_at = 0;
+};
+
+// Counter storage for VelocityEngine; defined in velocity.cpp
+struct VelocityTable;
+
+// In-memory velocity limits for the transfer path.
+//
+// Counters live in a sharded, fixed-capacity hash table; each key keeps
+// count and sum in fixed ring arrays of time buckets per window (12 x 5s,
+// 12 x 5min, 24 x 1h), so windows slide at bucket resolution and a check
+// never touches MongoDB. The table is one anonymous mapping guarded by
+// process-shared locks: in multi-process mode the supervisor creates it
+// before forking, so every worker checks and counts against the same
+// limits. It is rebuilt from recent transactions once, by the first worker.
+class VelocityEngine {
+private:
+    friend struct VelocityTable;
+    
+    // 16 bytes so a key's 48 buckets span 12 cache lines
+    struct Bucket {
+        uint32_t epoch;
+        uint32_t count;
+        double amount;
+    };
+    
+    template <int Width, int Count>
+    struct RingWindow {
+        Bucket buckets[Count] = {};
+        
+        void add(int64_t at, int count, double amount) {
+            uint32_t epoch = static_cast<uint32_t>(at / Width);
+            Bucket& bucket = buckets[epoch % Count];
+            if (bucket.epoch != epoch) {
+                bucket = Bucket{epoch, 0, 0.0};
+            }
+            bucket.count += count;
+            bucket.amount += amount;
+        }
+        
+        void remove(int64_t at, double amount) {
+            uint32_t epoch = static_cast<uint32_t>(at / Width);
+            Bucket& bucket = buckets[epoch % Count];
+            if (bucket.epoch == epoch && bucket.count > 0) {
+                bucket.count--;
+                bucket.amount -= amount;
+            }
+        }
+        
+        void total(int64_t now, long long& count, double& amount) const {
+            int64_t current = now / Width;
+            for (const Bucket& bucket : buckets) {
+                if (bucket.epoch > current - Count && bucket.epoch <= current && bucket.count > 0) {
+                    count += bucket.count;
+                    amount += bucket.amount;
+                }
+            }
+        }
+    };
+    
+    struct Counters {
+        RingWindow<5, 12> minute;
+        RingWindow<300, 12> hour;
+        RingWindow<3600, 24> day;
+        int64_t last_seen = 0;
+        
+        void add(int64_t at, double amount);
+        void remove(int64_t at, double amount);
+        void total(VelocityWindow window, int64_t now, long long& count, double& amount) const;
+    };
+    
+    std::vector<VelocityRule> rules;
+    VelocityTable* table;
+    bool owns_table;
+    
+public:
+    // Account and user keys the default table holds; ~800 bytes each, and
+    // pages are only committed as keys land on them
+    static constexpr size_t kDefaultTableKeys = size_t(1) << 18;
+    
+    // With no table the engine allocates a private one
+    explicit VelocityEngine(std::vector<VelocityRule> rules = defaultRules(), VelocityTable* shared_table = nullptr);
+    ~VelocityEngine();
+    
+    VelocityEngine(const VelocityEngine&) = delete;
+    VelocityEngine& operator=(const VelocityEngine&) = delete;
+    
+    // Allocates a table in an anonymous mapping; with shared set it stays
+    // shared across fork(). A shared table is never freed: it lives as long
+    // as the process.
+    static VelocityTable* createTable(size_t keys, bool shared);
+    
+    static std::vector<VelocityRule> defaultRules();
+    // Reads {"rules": [{"reason_code", "scope", "window", "max_count", "max_amount"}]}
+    static bool loadRules(const std::string& path, std::vector<VelocityRule>& rules);
+    
+    // Checks every rule and, if all pass, counts the transfer in the same step.
+    // Rejects with VELOCITY_CAPACITY when the table has no room for a new key.
+    VelocityDecision admit(const std::string& account_id, const std::string& user_id, double amount);
+    // Takes back an admitted transfer that then failed
+    void release(const std::string& account_id, const std::string& user_id, double amount, int64_t admitted_at);
+    // Counts a transfer that already happened without checking the rules
+    void record(const std::string& account_id, const std::string& user_id, double amount, int64_t at);
+    
+    // Replays the last 24 hours of transfers; returns how many were counted.
+    // Against a shared table only the first caller replays; the others wait
+    // for it to finish and return 0.
+    size_t rebuild(Database* db);
+};
+
+#endif
@@ -1,11 +1,15 @@
 #include "auth.h"
 #include <openssl/sha.h>
 #include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/crypto.h>
 #include <openssl/rand.h>
 #include <iomanip>
 #include <sstream>
 #include <map>
 #include <chrono>
+#include <cstdlib>
+#include <mutex>
 
 std::string Auth::hashPassword(const std::string& password) {
     unsigned char hash[SHA256_DIGEST_LENGTH];
@@ -27,8 +31,41 @@ bool Auth::verifyPassword(const std::string& password, const std::string& hash)
 
 // Simple token storage (in production, use Redis or database)
 static std::map<std::string, std::pair<std::string, std::chrono::time_point<std::chrono::system_clock>>> token_store;
+static std::mutex token_store_mutex;
+
+// Shared signing key for stateless tokens; empty means use token_store
+static std::string token_secret;
+
+void Auth::setTokenSecret(const std::string& secret) {
+    token_secret = secret;
+}
+
+void Auth::clearTokenStore() {
+    std::lock_guard<std::mutex> lock(token_store_mutex);
+    token_store.clear();
+}
+
+static std::string signToken(const std::string& payload) {
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    HMAC(EVP_sha256(), token_secret.data(), static_cast<int>(token_secret.size()),
+         reinterpret_cast<const unsigned char*>(payload.data()), payload.size(), digest, &length);
+    
+    std::stringstream ss;
+    for (unsigned int i = 0; i < length; i++) {
+        ss << std::hex << std::setw(2) << std::setfill('0') << (int)digest[i];
+    }
+    return ss.str();
+}
 
 std::string Auth::generateToken(const std::string& user_id) {
+    if (!token_secret.empty()) {
+        // <user_id>.<expiry, unix seconds>.<signature>
+        auto expiry = std::chrono::system_clock::now() + std::chrono::hours(24);
+        std::string payload = user_id + "." + std::to_string(std::chrono::system_clock::to_time_t(expiry));
+        return payload + "." + signToken(payload);
+    }
+    
     std::string token;
     unsigned char buffer[32];
     RAND_bytes(buffer, sizeof(buffer));
@@ -40,12 +77,36 @@ std::string Auth::generateToken(const std::string& user_id) {
     token = ss.str();
     
     auto expiry = std::chrono::system_clock::now() + std::chrono::hours(24);
+    std::lock_guard<std::mutex> lock(token_store_mutex);
     token_store[token] = {user_id, expiry};
     
     return token;
 }
 
 bool Auth::verifyToken(const std::string& token, std::string& user_id) {
+    if (!token_secret.empty()) {
+        size_t signature_start = token.rfind('.');
+        size_t expiry_start = signature_start == std::string::npos ? std::string::npos : token.rfind('.', signature_start - 1);
+        if (expiry_start == std::string::npos || expiry_start == 0) {
+            return false;
+        }
+        
+        std::string payload = token.substr(0, signature_start);
+        std::string expected = signToken(payload);
+        std::string signature = token.substr(signature_start + 1);
+        if (signature.size() != expected.size() || CRYPTO_memcmp(signature.data(), expected.data(), expected.size()) != 0) {
+            return false;
+        }
+        
+        long long expiry = std::atoll(token.c_str() + expiry_start + 1);
+        if (std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()) >= expiry) {
+            return false;
+        }
+        user_id = token.substr(0, expiry_start);
+        return true;
+    }
+    
+    std::lock_guard<std::mutex> lock(token_store_mutex);
     auto it = token_store.find(token);
     if (it != token_store.end()) {
         if (std::chrono::system_clock::now() < it->second.second) {
@@ -0,0 +1,486 @@
+#include "batch_jobs.h"
+#include "rollups.h"
+#include "thread_pool.h"
+#include "utils.h"
+#include <mongocxx/client.hpp>
+#include <mongocxx/pool.hpp>
+#include <mongocxx/uri.hpp>
+#include <mongocxx/options/find.hpp>
+#include <mongocxx/model/update_one.hpp>
+#include <bsoncxx/builder/stream/document.hpp>
+#include <bsoncxx/builder/stream/array.hpp>
+#include <bsoncxx/oid.hpp>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+using bsoncxx::builder::stream::document;
+using bsoncxx::builder::stream::open_document;
+using bsoncxx::builder::stream::close_document;
+using bsoncxx::builder::stream::finalize;
+
+// Adding and subtracting 1.5 * 2^52 rounds a double to the nearest integer
+// (ties to even) using plain arithmetic, which vectorizes where std::round
+// does not. Valid for |x| < 2^51, far beyond any balance in cents.
+static const double kRoundingConstant = 6755399441055744.0;
+
+// Accounts per gather block inside the kernel; sized to stay in L1
+static const size_t kKernelBlock = 256;
+
+// Rate index 0 is reserved for account types with no configured terms
+static const uint8_t kUnknownRateIndex = 0;
+
+// Columnar view of one batch of accounts
+struct AccrualBatch {
+    std::vector<bsoncxx::oid> account_ids;
+    std::vector<double> balances;
+    std::vector<uint8_t> rate_index;
+    std::vector<uint8_t> interest_due;  // 0 once this run has credited the account
+    std::vector<uint8_t> fee_due;       // 0 once this month's fee has been charged
+    std::vector<double> interest;
+    std::vector<double> fees;
+    int64_t read_at = 0;                // microseconds; when the first balance was read
+    
+    size_t size() const { return account_ids.size(); }
+    
+    void clear() {
+        account_ids.clear();
+        balances.clear();
+        rate_index.clear();
+        interest_due.clear();
+        fee_due.clear();
+    }
+};
+
+std::map<std::string, AccrualRate> BatchJobs::defaultRates() {
+    return {
+        {"savings", {0.04, 0.0, 0.0}},
+        {"checking", {0.001, 5.0, 1000.0}},
+        {"business", {0.0, 15.0, 5000.0}},
+    };
+}
+
+void BatchJobs::accrueKernel(const double* balances, const uint8_t* rate_index,
+                             const double* daily_rates, const double* fees, const double* waiver_balances,
+                             double* interest_out, double* fee_out, size_t n) {
+    double rate[kKernelBlock];
+    double fee[kKernelBlock];
+    double waiver[kKernelBlock];
+    
+    for (size_t start = 0; start < n; start += kKernelBlock) {
+        size_t count = std::min(kKernelBlock, n - start);
+        const double* __restrict balance = balances + start;
+        double* __restrict interest = interest_out + start;
+        double* __restrict charged = fee_out + start;
+        
+        // Scalar gather of the per-type terms, then a branch-free loop the
+        // compiler turns into SIMD compares, selects and multiplies
+        for (size_t i = 0; i < count; ++i) {
+            uint8_t index = rate_index[start + i];
+            rate[i] = daily_rates[index];
+            fee[i] = fees[index];
+            waiver[i] = waiver_balances[index];
+        }
+        
+        for (size_t i = 0; i < count; ++i) {
+            double positive = balance[i] > 0.0 ? balance[i] : 0.0;
+            double cents = positive * rate[i] * 100.0;
+            interest[i] = ((cents + kRoundingConstant) - kRoundingConstant) / 100.0;
+            double below_waiver = balance[i] < waiver[i] ? 1.0 : 0.0;
+            charged[i] = fee[i] * below_waiver;
+        }
+    }
+}
+
+// Adds amount to one side of an account's day and month rollups, at most
+// once per stamp. The first update only makes sure the rollup exists; the
+// second matches only while the rollup lacks the stamp, like the balance
+// updates, so a replayed batch leaves the counters alone.
+static void appendRollupIncrement(mongocxx::bulk_write& rollups, const std::string& account_id,
+                                  const std::string& timestamp, const std::string& field, double amount,
+                                  const std::string& stamp_field, const std::string& stamp) {
+    for (const std::string granularity : {"day", "month"}) {
+        std::string period = Rollups::periodKey(timestamp, granularity);
+        auto key = document{} << "account_id" << account_id
+                             << "granularity" << granularity
+                             << "period" << period << finalize;
+        auto create = document{} << "$setOnInsert" << open_document
+                                << "count" << 0
+                                << "debits" << 0.0
+                                << "credits" << 0.0
+                                << "closing_balance" << 0.0
+                                << close_document << finalize;
+        mongocxx::model::update_one upsert{key.view(), create.view()};
+        upsert.upsert(true);
+        rollups.append(upsert);
+        
+        auto filter = document{} << "account_id" << account_id
+                                << "granularity" << granularity
+                                << "period" << period
+                                << stamp_field << open_document
+                                << "$ne" << stamp
+                                << close_document << finalize;
+        auto update = document{} << "$inc" << open_document
+                                << "count" << 1
+                                << field << amount
+                                << close_document
+                                << "$set" << open_document
+                                << stamp_field << stamp
+                                << close_document << finalize;
+        rollups.append(mongocxx::model::update_one{filter.view(), update.view()});
+    }
+}
+
+// Sets the closing balance of an account's day and month rollups unless a
+// transfer has since written a more recent one
+static void appendRollupClosingBalance(mongocxx::bulk_write& rollups, const std::string& account_id,
+                                       const std::string& timestamp, double balance, int64_t balance_as_of) {
+    for (const std::string granularity : {"day", "month"}) {
+        auto filter = document{} << "account_id" << account_id
+                                << "granularity" << granularity
+                                << "period" << Rollups::periodKey(timestamp, granularity)
+                                << "$or" << bsoncxx::builder::stream::open_array
+                                << open_document << "balance_as_of" << open_document
+                                << "$exists" << false << close_document << close_document
+                                << open_document << "balance_as_of" << open_document
+                                << "$lte" << balance_as_of << close_document << close_document
+                                << bsoncxx::builder::stream::close_array << finalize;
+        auto update = document{} << "$set" << open_document
+                                << "closing_balance" << balance
+                                << "balance_as_of" << balance_as_of
+                                << "updated_at" << timestamp
+                                << close_document << finalize;
+        rollups.append(mongocxx::model::update_one{filter.view(), update.view()});
+    }
+}
+
+// Amounts of the transactions a run already recorded for these accounts,
+// by account id. Normally there are none; a crash between a batch's
+// transaction and balance writes leaves some behind.
+static std::unordered_map<std::string, double> recordedAmounts(mongocxx::database& db, const std::string& batch_run,
+                                                               const std::string& account_field,
+                                                               const std::vector<std::string>& account_ids) {
+    std::unordered_map<std::string, double> amounts;
+    if (account_ids.empty()) {
+        return amounts;
+    }
+    auto ids = bsoncxx::builder::stream::array{};
+    for (const auto& id : account_ids) {
+        ids << id;
+    }
+    auto filter = document{} << "batch_run" << batch_run
+                            << account_field << open_document
+                            << "$in" << bsoncxx::types::b_array{ids.view()}
+                            << close_document << finalize;
+    mongocxx::options::find options;
+    options.projection(document{} << account_field << 1 << "amount" << 1 << finalize);
+    for (auto&& doc : db["transactions"].find(filter.view(), options)) {
+        amounts[doc[account_field].get_utf8().value.to_string()] = doc["amount"].get_double().value;
+    }
+    return amounts;
+}
+
+// Writes one computed batch: transaction records first, then the balance
+// updates, then the checkpoint. Interest is keyed by the run (one per day)
+// and fees by the fee period (one per month): transactions are upserted by
+// those ids, and each balance update only matches accounts not yet stamped
+// with them, so replaying a batch after a crash, or running with fees on a
+// second day of the month, is a no-op for work already done. An account
+// whose transaction was recorded but whose balance was not is credited or
+// charged the recorded amount, not a recomputed one, since its balance may
+// have moved since. Rollups are updated last, under the same stamps.
+static bool writeBatch(mongocxx::pool& pool, const std::string& job_id, const std::string& run_date,
+                       const std::string& fee_period, const AccrualBatch& batch, size_t processed,
+                       AccrualSummary& summary) {
+    try {
+        auto client = pool.acquire();
+        auto db = (*client)["banking_system"];
+        std::string timestamp = Utils::getCurrentTimestamp();
+        std::string fee_run = "fee:" + fee_period;
+        
+        auto transactions = db["transactions"].create_bulk_write();
+        auto accounts = db["accounts"].create_bulk_write();
+        auto rollups = db["account_rollups"].create_bulk_write();
+        size_t writes = 0;
+        
+        std::vector<std::string> account_ids(batch.size());
+        std::vector<std::string> interest_due;
+        std::vector<std::string> fee_due;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            account_ids[i] = batch.account_ids[i].to_string();
+            if (batch.interest_due[i]) {
+                interest_due.push_back(account_ids[i]);
+            }
+            if (batch.fee_due[i]) {
+                fee_due.push_back(account_ids[i]);
+            }
+        }
+        auto recorded_interest = recordedAmounts(db, job_id, "to_account", interest_due);
+        auto recorded_fees = recordedAmounts(db, fee_run, "from_account", fee_due);
+        
+        for (size_t i = 0; i < batch.size(); ++i) {
+            const std::string& account_id = account_ids[i];
+            double interest = batch.interest_due[i] ? batch.interest[i] : 0.0;
+            double fee = batch.fee_due[i] ? batch.fees[i] : 0.0;
+            auto recorded = recorded_interest.find(account_id);
+            if (batch.interest_due[i] && recorded != recorded_interest.end()) {
+                interest = recorded->second;
+            }
+            recorded = recorded_fees.find(account_id);
+            if (batch.fee_due[i] && recorded != recorded_fees.end()) {
+                fee = recorded->second;
+            }
+            if (interest == 0.0 && fee == 0.0) {
+                continue;
+            }
+            
+            if (interest != 0.0) {
+                auto filter = document{} << "batch_run" << job_id
+                                        << "transaction_type" << "interest"
+                                        << "to_account" << account_id << finalize;
+                auto update = document{} << "$setOnInsert" << open_document
+                                        << "from_account" << ""
+                                        << "amount" << interest
+                                        << "description" << "Interest accrual " + run_date
+                                        << "timestamp" << timestamp
+                                        << "status" << "completed"
+                                        << close_document << finalize;
+                mongocxx::model::update_one upsert{filter.view(), update.view()};
+                upsert.upsert(true);
+                transactions.append(upsert);
+            }
+            
+            if (fee != 0.0) {
+                auto filter = document{} << "batch_run" << fee_run
+                                        << "transaction_type" << "fee"
+                                        << "from_account" << account_id << finalize;
+                auto update = document{} << "$setOnInsert" << open_document
+                                        << "to_account" << ""
+                                        << "amount" << fee
+                                        << "description" << "Monthly maintenance fee " + fee_period
+                                        << "timestamp" << timestamp
+                                        << "status" << "completed"
+                                        << close_document << finalize;
+                mongocxx::model::update_one upsert{filter.view(), update.view()};
+                upsert.upsert(true);
+                transactions.append(upsert);
+            }
+            
+            if (interest != 0.0) {
+                auto filter = document{} << "_id" << batch.account_ids[i]
+                                        << "last_accrual_run" << open_document
+                                        << "$ne" << job_id
+                                        << close_document << finalize;
+                auto update = document{} << "$inc" << open_document
+                                        << "balance" << interest
+                                        << close_document
+                                        << "$set" << open_document
+                                        << "last_accrual_run" << job_id
+                                        << close_document << finalize;
+                accounts.append(mongocxx::model::update_one{filter.view(), update.view()});
+            }
+            
+            if (fee != 0.0) {
+                auto filter = document{} << "_id" << batch.account_ids[i]
+                                        << "last_fee_period" << open_document
+                                        << "$ne" << fee_period
+                                        << close_document << finalize;
+                auto update = document{} << "$inc" << open_document
+                                        << "balance" << -fee
+                                        << close_document
+                                        << "$set" << open_document
+                                        << "last_fee_period" << fee_period
+                                        << close_document << finalize;
+                accounts.append(mongocxx::model::update_one{filter.view(), update.view()});
+            }
+            
+            if (interest != 0.0) {
+                appendRollupIncrement(rollups, account_id, timestamp, "credits", interest, "last_accrual_run", job_id);
+            }
+            if (fee != 0.0) {
+                appendRollupIncrement(rollups, account_id, timestamp, "debits", fee, "last_fee_period", fee_period);
+            }
+            appendRollupClosingBalance(rollups, account_id, timestamp, batch.balances[i] + interest - fee, batch.read_at);
+            
+            summary.interest_total += interest;
+            summary.fees_total += fee;
+            writes++;
+        }
+        
+        if (writes > 0) {
+            transactions.execute();
+            accounts.execute();
+            rollups.execute();
+        }
+        summary.updated += writes;
+        
+        auto checkpoint_filter = document{} << "_id" << job_id << finalize;
+        auto checkpoint = document{} << "$set" << open_document
+                                    << "last_account_id" << batch.account_ids.back()
+                                    << "processed" << static_cast<int64_t>(processed)
+                                    << "updated" << static_cast<int64_t>(summary.updated)
+                                    << "interest_total" << summary.interest_total
+                                    << "fees_total" << summary.fees_total
+                                    << "completed" << false
+                                    << "updated_at" << timestamp
+                                    << close_document << finalize;
+        mongocxx::options::update upsert;
+        upsert.upsert(true);
+        db["batch_checkpoints"].update_one(checkpoint_filter.view(), checkpoint.view(), upsert);
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Error writing accrual batch: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool BatchJobs::runAccrual(const AccrualOptions& options, AccrualSummary& summary) {
+    auto start = std::chrono::steady_clock::now();
+    std::string run_date = options.run_date.empty() ? Utils::getCurrentTimestamp().substr(0, 10) : options.run_date;
+    std::string job_id = "accrue:" + run_date;
+    std::string fee_period = run_date.substr(0, 7);
+    
+    // Per-type terms flattened into small tables indexed by rate_index
+    std::map<std::string, uint8_t> type_index;
+    std::vector<double> daily_rates{0.0};
+    std::vector<double> fees{0.0};
+    std::vector<double> waiver_balances{0.0};
+    for (const auto& entry : options.rates) {
+        if (daily_rates.size() > 255) {
+            std::cerr << "Too many account types" << std::endl;
+            return false;
+        }
+        type_index[entry.first] = static_cast<uint8_t>(daily_rates.size());
+        daily_rates.push_back(entry.second.annual_rate / 365.0);
+        fees.push_back(options.charge_fees ? entry.second.monthly_fee : 0.0);
+        waiver_balances.push_back(entry.second.fee_waiver_balance);
+    }
+    
+    try {
+        mongocxx::pool pool{mongocxx::uri{options.mongo_uri}};
+        auto client = pool.acquire();
+        auto db = (*client)["banking_system"];
+        auto checkpoints = db["batch_checkpoints"];
+        auto checkpoint_filter = document{} << "_id" << job_id << finalize;
+        
+        // Resume after the last account of the last committed batch
+        auto account_filter = document{} << "status" << "active" << finalize;
+        size_t processed = 0;
+        auto checkpoint = checkpoints.find_one(checkpoint_filter.view());
+        if (checkpoint && options.restart) {
+            checkpoints.delete_one(checkpoint_filter.view());
+        } else if (checkpoint) {
+            auto doc = checkpoint->view();
+            if (doc["completed"] && doc["completed"].get_bool().value) {
+                summary.already_completed = true;
+                return true;
+            }
+            processed = static_cast<size_t>(doc["processed"].get_int64().value);
+            summary.updated = static_cast<size_t>(doc["updated"].get_int64().value);
+            summary.interest_total = doc["interest_total"].get_double().value;
+            summary.fees_total = doc["fees_total"].get_double().value;
+            summary.resumed = true;
+            account_filter = document{} << "status" << "active"
+                                       << "_id" << open_document
+                                       << "$gt" << doc["last_account_id"].get_oid().value
+                                       << close_document << finalize;
+            std::cout << "Resuming " << job_id << " after " << processed << " accounts" << std::endl;
+        }
+        
+        mongocxx::options::find find_options;
+        find_options.sort(document{} << "_id" << 1 << finalize);
+        find_options.projection(document{} << "balance" << 1 << "account_type" << 1
+                                            << "last_accrual_run" << 1 << "last_fee_period" << 1 << finalize);
+        find_options.batch_size(static_cast<int32_t>(options.batch_size));
+        auto cursor = db["accounts"].find(account_filter.view(), find_options);
+        
+        size_t threads = options.threads ? options.threads : std::thread::hardware_concurrency();
+        ThreadPool compute_pool(threads);
+        AccrualBatch batches[2];
+        int current = 0;
+        std::future<bool> pending_write;
+        bool write_failed = false;
+        size_t started_at = processed;
+        
+        auto flush = [&](AccrualBatch& batch) {
+            size_t n = batch.size();
+            batch.interest.resize(n);
+            batch.fees.resize(n);
+            compute_pool.parallelFor(n, 4096, [&](size_t begin, size_t end) {
+                accrueKernel(batch.balances.data() + begin, batch.rate_index.data() + begin,
+                             daily_rates.data(), fees.data(), waiver_balances.data(),
+                             batch.interest.data() + begin, batch.fees.data() + begin, end - begin);
+            });
+            
+            // Keep one write in flight while the next batch is read and computed
+            if (pending_write.valid() && !pending_write.get()) {
+                write_failed = true;
+                return;
+            }
+            processed += n;
+            pending_write = std::async(std::launch::async, writeBatch, std::ref(pool), job_id, run_date,
+                                       fee_period, std::cref(batch), processed, std::ref(summary));
+            
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "Processed " << processed << " accounts ("
+                      << static_cast<long long>((processed - started_at) / elapsed) << " accounts/s)" << std::endl;
+        };
+        
+        for (auto&& doc : cursor) {
+            AccrualBatch& batch = batches[current];
+            if (batch.size() == 0) {
+                batch.read_at = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+            }
+            auto type = type_index.find(doc["account_type"].get_utf8().value.to_string());
+            batch.account_ids.push_back(doc["_id"].get_oid().value);
+            batch.balances.push_back(doc["balance"].get_double().value);
+            batch.rate_index.push_back(type != type_index.end() ? type->second : kUnknownRateIndex);
+            // Balances of accounts already stamped include that credit or fee
+            auto credited = doc["last_accrual_run"];
+            batch.interest_due.push_back(!(credited && credited.get_utf8().value.to_string() == job_id));
+            auto charged = doc["last_fee_period"];
+            batch.fee_due.push_back(!(charged && charged.get_utf8().value.to_string() == fee_period));
+            
+            if (batch.size() >= options.batch_size) {
+                flush(batch);
+                if (write_failed) {
+                    break;
+                }
+                // The other buffer's write has finished by the time flush returns
+                current ^= 1;
+                batches[current].clear();
+            }
+        }
+        
+        if (!write_failed && batches[current].size() > 0) {
+            flush(batches[current]);
+        }
+        if (pending_write.valid() && !pending_write.get()) {
+            write_failed = true;
+        }
+        if (write_failed) {
+            std::cerr << "Accrual stopped; rerun to resume from the last checkpoint" << std::endl;
+            return false;
+        }
+        
+        auto completed = document{} << "$set" << open_document
+                                   << "completed" << true
+                                   << "processed" << static_cast<int64_t>(processed)
+                                   << "updated_at" << Utils::getCurrentTimestamp()
+                                   << close_document << finalize;
+        mongocxx::options::update upsert;
+        upsert.upsert(true);
+        checkpoints.update_one(checkpoint_filter.view(), completed.view(), upsert);
+        
+        summary.accounts = processed - started_at;
+    } catch (const std::exception& e) {
+        std::cerr << "Accrual error: " << e.what() << std::endl;
+        return false;
+    }
+    
+    summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
@@ -1,8 +1,17 @@
 #include "database.h"
 #include "utils.h"
 #include <mongocxx/uri.hpp>
+#include <mongocxx/exception/operation_exception.hpp>
+#include <mongocxx/options/find.hpp>
+#include <mongocxx/model/delete_many.hpp>
+#include <mongocxx/model/insert_one.hpp>
+#include <mongocxx/model/update_one.hpp>
 #include <bsoncxx/builder/stream/document.hpp>
+#include <bsoncxx/builder/stream/array.hpp>
 #include <bsoncxx/json.hpp>
+#include <bsoncxx/types.hpp>
+#include "rollups.h"
+#include <chrono>
 #include <iostream>
 
 using bsoncxx::builder::stream::document;
@@ -10,11 +19,28 @@ using bsoncxx::builder::stream::open_document;
 using bsoncxx::builder::stream::close_document;
 using bsoncxx::builder::stream::finalize;
 
-Database::Database() : client{mongocxx::uri{"mongodb://localhost:27017"}}, db{client["banking_system"]} {}
+// Counters written with $inc, or by hand, may be stored as any numeric type
+static double numericValue(const bsoncxx::document::element& element) {
+    switch (element.type()) {
+        case bsoncxx::type::k_double:
+            return element.get_double().value;
+        case bsoncxx::type::k_int32:
+            return element.get_int32().value;
+        case bsoncxx::type::k_int64:
+            return static_cast<double>(element.get_int64().value);
+        default:
+            return 0.0;
+    }
+}
+
+Database::Database() : pool{new mongocxx::pool{mongocxx::uri{"mongodb://localhost:27017"}}} {}
+
+Database::Database(Unconnected) {}
 
 bool Database::createUser(const User& user) {
     try {
-        auto collection = db["users"];
+        auto client = pool->acquire();
+        auto collection = (*client)["banking_system"]["users"];
         
         document doc{};
         doc << "username" << user.username
@@ -35,7 +61,8 @@ bool Database::createUser(const User& user) {
 User Database::getUserByUsername(const std::string& username) {
     User user;
     try {
-        auto collection = db["users"];
+        auto client = pool->acquire();
+        auto collection = (*client)["banking_system"]["users"];
         auto filter = document{} << "username" << username << finalize;
         auto result = collection.find_one(filter.view());
         
@@ -52,15 +79,38 @@ User Database::getUserByUsername(const std::string& username) {
     return user;
 }
 
+User Database::getUserById(const std::string& id) {
+    User user;
+    try {
+        auto client = pool->acquire();
+        auto collection = (*client)["banking_system"]["users"];
+        auto filter = document{} << "_id" << bsoncxx::oid{id} << finalize;
+        auto result = collection.find_one(filter.view());
+        
+        if (result) {
+            auto doc = result->view();
+            user.id = doc["_id"].get_oid().value.to_string();
+            user.username = doc["username"].get_utf8().value.to_string();
+            user.email = doc["email"].get_utf8().value.to_string();
+            user.password_hash = doc["password_hash"].get_utf8().value.to_string();
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error getting user by ID: " << e.what() << std::endl;
+    }
+    return user;
+}
+
 bool Database::createAccount(const Account& account) {
     try {
-        auto collection = db["accounts"];
+        auto client = pool->acquire();
+        auto collection = (*client)["banking_system"]["accounts"];
         
         document doc{};
         doc << "user_id" << account.user_id
             << "account_number" << account.account_number
             << "account_type" << account.account_type
             << "balance" << account.balance
+            << "opening_balance" << account.balance
             << "status" << account.status
             << "created_at" << Utils::getCurrentTimestamp();
             
@@ -75,7 +125,8 @@ bool Database::createAccount(const Account& account) {
 std::vector<Account> Database::getAccountsByUserId(const std::string& user_id) {
     std::vector<Account> accounts;
     try {
-        auto collection = db["accounts"];
+        auto client = pool->acquire();
+        auto collection = (*client)["banking_system"]["accounts"];
         auto filter = document{} << "user_id" << user_id << finalize;
         auto cursor = collection.find(filter.view());
         
@@ -98,7 +149,8 @@ std::vector<Account> Database::getAccountsByUserId(const std::string& user_id) {
 Account Database::getAccountByNumber(const std::string& account_number) {
     Account account;
     try {
-        auto collection = db["accounts"];
+        auto client = pool->acquire();
+        auto collection = (*client)["banking_system"]["accounts"];
         auto filter = document{} << "account_number" << account_number << finalize;
         auto result = collection.find_one(filter.view());
         
@@ -120,7 +172,8 @@ Account Database::getAccountByNumber(const std::string& account_number) {
 Account Database::getAccountById(const std::string& account_id) {
     Account account;
     try {
-        auto collection = db["accounts"];
+        auto client = pool->acquire();
+        auto collection = (*client)["banking_system"]["accounts"];
         auto filter = document{} << "_id" << bsoncxx::oid{account_id} << finalize;
         auto result = collection.find_one(filter.view());
         
@@ -141,7 +194,8 @@ Account Database::getAccountById(const std::string& account_id) {
 
 bool Database::updateAccountBalance(const std::string& account_id, double new_balance) {
     try {
-        auto collection = db["accounts"];
+        auto client = pool->acquire();
+        auto collection = (*client)["banking_system"]["accounts"];
         auto filter = document{} << "_id" << bsoncxx::oid{account_id} << finalize;
         auto update = document{} << "$set" << open_document 
                                 << "balance" << new_balance 
@@ -155,9 +209,31 @@ bool Database::updateAccountBalance(const std::string& account_id, double new_ba
     }
 }
 
-bool Database::createTransaction(const Transaction& transaction) {
+void Database::forEachAccount(const std::function<void(const Account&)>& callback) {
+    try {
+        auto client = pool->acquire();
+        auto collection = (*client)["banking_system"]["accounts"];
+        auto cursor = collection.find({});
+        
+        for (auto&& doc : cursor) {
+            Account account;
+            account.id = doc["_id"].get_oid().value.to_string();
+            account.user_id = doc["user_id"].get_utf8().value.to_string();
+            account.account_number = doc["account_number"].get_utf8().value.to_string();
+            account.account_type = doc["account_type"].get_utf8().value.to_string();
+            account.balance = doc["balance"].get_double().value;
+            account.status = doc["status"].get_utf8().value.to_string();
+            callback(account);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error iterating accounts: " << e.what() << std::endl;
+    }
+}
+
+bool Database::createTransaction(Transaction& transaction) {
     try {
-        auto collection = db["transactions"];
+        auto client = pool->acquire();
+        auto collection = (*client)["banking_system"]["transactions"];
         
         document doc{};
         doc << "from_account" << transaction.from_account
@@ -169,7 +245,11 @@ bool Database::createTransaction(const Transaction& transaction) {
             << "status" << transaction.status;
             
         auto result = collection.insert_one(doc.view());
-        return result.has_value();
+        if (!result) {
+            return false;
+        }
+        transaction.id = result->inserted_id().get_oid().value.to_string();
+        return true;
     } catch (const std::exception& e) {
         std::cerr << "Error creating transaction: " << e.what() << std::endl;
         return false;
@@ -179,7 +259,8 @@ bool Database::createTransaction(const Transaction& transaction) {
 std::vector<Transaction> Database::getTransactionsByAccountId(const std::string& account_id) {
     std::vector<Transaction> transactions;
     try {
-        auto collection = db["transactions"];
+        auto client = pool->acquire();
+        auto collection = (*client)["banking_system"]["transactions"];
         auto filter = document{} << "$or" << bsoncxx::builder::stream::open_array
                                 << open_document << "from_account" << account_id << close_document
                                 << open_document << "to_account" << account_id << close_document
@@ -205,6 +286,298 @@ std::vector<Transaction> Database::getTransactionsByAccountId(const std::string&
     return transactions;
 }
 
+std::vector<Transaction> Database::getTransactionsSince(const std::string& timestamp) {
+    std::vector<Transaction> transactions;
+    try {
+        auto client = pool->acquire();
+        auto collection = (*client)["banking_system"]["transactions"];
+        auto filter = document{} << "timestamp" << open_document
+                                << "$gte" << timestamp
+                                << close_document << finalize;
+        
+        mongocxx::options::find options;
+        options.sort(document{} << "timestamp" << 1 << finalize);
+        auto cursor = collection.find(filter.view(), options);
+        
+        for (auto&& doc : cursor) {
+            Transaction transaction;
+            transaction.id = doc["_id"].get_oid().value.to_string();
+            transaction.from_account = doc["from_account"].get_utf8().value.to_string();
+            transaction.to_account = doc["to_account"].get_utf8().value.to_string();
+            transaction.amount = doc["amount"].get_double().value;
+            transaction.transaction_type = doc["transaction_type"].get_utf8().value.to_string();
+            transaction.description = doc["description"].get_utf8().value.to_string();
+            transaction.timestamp = doc["timestamp"].get_utf8().value.to_string();
+            transaction.status = doc["status"].get_utf8().value.to_string();
+            transactions.push_back(transaction);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error getting recent transactions: " << e.what() << std::endl;
+    }
+    return transactions;
+}
+
 std::string Database::generateAccountNumber() {
     return "ACC" + Utils::generateRandomId(10);
 }
+
+bool Database::applyTransactionRollups(const Transaction& transaction, double from_balance, double to_balance) {
+    try {
+        auto client = pool->acquire();
+        auto collection = (*client)["banking_system"]["account_rollups"];
+        auto bulk = collection.create_bulk_write();
+        
+        struct Side {
+            const std::string& account_id;
+            std::string field;
+            double closing_balance;
+        };
+        const Side sides[] = {
+            {transaction.from_account, "debits", from_balance},
+            {transaction.to_account, "credits", to_balance},
+        };
+        
+        // Rollups are applied right after the balances are written, so the
+        // time of this call orders closing balances between concurrent transfers
+        int64_t balance_as_of = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        
+        // Two updates per account and granularity, sent in a single round trip:
+        // the counters always apply, the closing balance only if no later
+        // transfer has already set it
+        for (const auto& side : sides) {
+            for (const std::string granularity : {"day", "month"}) {
+                std::string period = Rollups::periodKey(transaction.timestamp, granularity);
+                auto filter = document{} << "account_id" << side.account_id
+                                        << "granularity" << granularity
+                                        << "period" << period
+                                        << finalize;
+                auto update = document{} << "$inc" << open_document
+                                        << "count" << 1
+                                        << side.field << transaction.amount
+                                        << close_document
+                                        << "$setOnInsert" << open_document
+                                        << "closing_balance" << side.closing_balance
+                                        << close_document << finalize;
+                
+                mongocxx::model::update_one upsert{filter.view(), update.view()};
+                upsert.upsert(true);
+                bulk.append(upsert);
+                
+                auto newer = document{} << "account_id" << side.account_id
+                                       << "granularity" << granularity
+                                       << "period" << period
+                                       << "$or" << bsoncxx::builder::stream::open_array
+                                       << open_document << "balance_as_of" << open_document
+                                       << "$exists" << false << close_document << close_document
+                                       << open_document << "balance_as_of" << open_document
+                                       << "$lte" << balance_as_of << close_document << close_document
+                                       << bsoncxx::builder::stream::close_array << finalize;
+                auto closing = document{} << "$set" << open_document
+                                         << "closing_balance" << side.closing_balance
+                                         << "balance_as_of" << balance_as_of
+                                         << "updated_at" << transaction.timestamp
+                                         << close_document << finalize;
+                bulk.append(mongocxx::model::update_one{newer.view(), closing.view()});
+            }
+        }
+        
+        auto result = bulk.execute();
+        return result.has_value();
+    } catch (const std::exception& e) {
+        std::cerr << "Error applying rollups: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+std::vector<AccountRollup> Database::getAccountRollups(const std::string& account_id, const std::string& granularity) {
+    std::vector<AccountRollup> rollups;
+    try {
+        auto client = pool->acquire();
+        auto collection = (*client)["banking_system"]["account_rollups"];
+        auto filter = document{} << "account_id" << account_id
+                                << "granularity" << granularity << finalize;
+        
+        mongocxx::options::find options;
+        options.sort(document{} << "period" << 1 << finalize);
+        auto cursor = collection.find(filter.view(), options);
+        
+        for (auto&& doc : cursor) {
+            AccountRollup rollup;
+            rollup.account_id = doc["account_id"].get_utf8().value.to_string();
+            rollup.granularity = doc["granularity"].get_utf8().value.to_string();
+            rollup.period = doc["period"].get_utf8().value.to_string();
+            rollup.count = static_cast<long long>(numericValue(doc["count"]));
+            rollup.debits = doc["debits"] ? numericValue(doc["debits"]) : 0.0;
+            rollup.credits = doc["credits"] ? numericValue(doc["credits"]) : 0.0;
+            rollup.closing_balance = numericValue(doc["closing_balance"]);
+            rollups.push_back(rollup);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error getting rollups: " << e.what() << std::endl;
+    }
+    return rollups;
+}
+
+bool Database::replaceAccountRollups(const std::string& account_id, const std::vector<AccountRollup>& rollups) {
+    try {
+        auto client = pool->acquire();
+        auto collection = (*client)["banking_system"]["account_rollups"];
+        auto bulk = collection.create_bulk_write();
+        
+        auto filter = document{} << "account_id" << account_id << finalize;
+        bulk.append(mongocxx::model::delete_many{filter.view()});
+        
+        for (const auto& rollup : rollups) {
+            auto doc = document{} << "account_id" << rollup.account_id
+                                 << "granularity" << rollup.granularity
+                                 << "period" << rollup.period
+                                 << "count" << static_cast<int32_t>(rollup.count)
+                                 << "debits" << rollup.debits
+                                 << "credits" << rollup.credits
+                                 << "closing_balance" << rollup.closing_balance
+                                 << "updated_at" << Utils::getCurrentTimestamp()
+                                 << finalize;
+            bulk.append(mongocxx::model::insert_one{doc.view()});
+        }
+        
+        auto result = bulk.execute();
+        return result.has_value();
+    } catch (const std::exception& e) {
+        std::cerr << "Error replacing rollups: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+// A pending claim not renewed for this long belongs to a request that died
+// mid-flight; live owners renew well within it (see IdempotencyStore)
+static const std::chrono::seconds kAbandonedClaimAge(60);
+
+ClaimResult Database::claimIdempotencyKey(const std::string& key, const std::string& fingerprint) {
+    try {
+        auto client = pool->acquire();
+        auto collection = (*client)["banking_system"]["idempotency_keys"];
+        auto now = std::chrono::system_clock::now();
+        
+        document doc{};
+        doc << "key" << key
+            << "fingerprint" << fingerprint
+            << "status_code" << 0
+            << "body" << std::string()
+            << "content_type" << std::string()
+            << "created_at" << bsoncxx::types::b_date{now};
+        
+        try {
+            collection.insert_one(doc.view());
+            return ClaimResult::Claimed;
+        } catch (const mongocxx::operation_exception& e) {
+            // 11000: duplicate key, i.e. the key is already claimed or completed
+            if (e.code().value() != 11000) {
+                throw;
+            }
+        }
+        
+        auto filter = document{} << "key" << key
+                                << "status_code" << 0
+                                << "created_at" << open_document
+                                << "$lt" << bsoncxx::types::b_date{now - kAbandonedClaimAge}
+                                << close_document << finalize;
+        auto update = document{} << "$set" << open_document
+                                << "fingerprint" << fingerprint
+                                << "created_at" << bsoncxx::types::b_date{now}
+                                << close_document << finalize;
+        auto result = collection.update_one(filter.view(), update.view());
+        return result && result->modified_count() > 0 ? ClaimResult::Claimed : ClaimResult::Taken;
+    } catch (const std::exception& e) {
+        // Another process or a restart could run the request too, so an
+        // unreachable database never counts as a claim
+        std::cerr << "Error claiming idempotency key: " << e.what() << std::endl;
+        return ClaimResult::Unavailable;
+    }
+}
+
+bool Database::renewIdempotencyClaims(const std::vector<std::string>& keys) {
+    try {
+        auto client = pool->acquire();
+        auto collection = (*client)["banking_system"]["idempotency_keys"];
+        
+        auto key_list = bsoncxx::builder::stream::array{};
+        for (const auto& key : keys) {
+            key_list << key;
+        }
+        auto filter = document{} << "key" << open_document
+                                << "$in" << bsoncxx::types::b_array{key_list.view()}
+                                << close_document
+                                << "status_code" << 0 << finalize;
+        auto update = document{} << "$set" << open_document
+                                << "created_at" << bsoncxx::types::b_date{std::chrono::system_clock::now()}
+                                << close_document << finalize;
+        auto result = collection.update_many(filter.view(), update.view());
+        return result.has_value();
+    } catch (const std::exception& e) {
+        std::cerr << "Error renewing idempotency claims: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool Database::findIdempotencyRecord(const std::string& key, IdempotencyRecord& record) {
+    try {
+        auto client = pool->acquire();
+        auto collection = (*client)["banking_system"]["idempotency_keys"];
+        auto filter = document{} << "key" << key << finalize;
+        auto result = collection.find_one(filter.view());
+        
+        if (result) {
+            auto doc = result->view();
+            record.key = doc["key"].get_utf8().value.to_string();
+            record.fingerprint = doc["fingerprint"].get_utf8().value.to_string();
+            record.status_code = doc["status_code"].get_int32().value;
+            record.body = doc["body"].get_utf8().value.to_string();
+            record.content_type = doc["content_type"].get_utf8().value.to_string();
+            return true;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error getting idempotency record: " << e.what() << std::endl;
+    }
+    return false;
+}
+
+bool Database::saveIdempotencyRecord(const IdempotencyRecord& record) {
+    try {
+        auto client = pool->acquire();
+        auto collection = (*client)["banking_system"]["idempotency_keys"];
+        
+        // Completes the claim; created_at must be a BSON date for the TTL index to expire it
+        auto filter = document{} << "key" << record.key << finalize;
+        auto update = document{} << "$set" << open_document
+                                << "fingerprint" << record.fingerprint
+                                << "status_code" << record.status_code
+                                << "body" << record.body
+                                << "content_type" << record.content_type
+                                << close_document
+                                << "$setOnInsert" << open_document
+                                << "created_at" << bsoncxx::types::b_date{std::chrono::system_clock::now()}
+                                << close_document << finalize;
+        
+        mongocxx::options::update options;
+        options.upsert(true);
+        auto result = collection.update_one(filter.view(), update.view(), options);
+        return result.has_value();
+    } catch (const std::exception& e) {
+        std::cerr << "Error saving idempotency record: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool Database::releaseIdempotencyKey(const std::string& key) {
+    try {
+        auto client = pool->acquire();
+        auto collection = (*client)["banking_system"]["idempotency_keys"];
+        auto filter = document{} << "key" << key << "status_code" << 0 << finalize;
+        auto result = collection.delete_one(filter.view());
+        return result && result->deleted_count() > 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Error releasing idempotency key: " << e.what() << std::endl;
+        return false;
+    }
+}
@@ -0,0 +1,281 @@
+#include "idempotency.h"
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+static StoredResponse mismatchResponse() {
+    return StoredResponse{422, "Idempotency-Key was already used for a different request", ""};
+}
+
+static StoredResponse inProgressResponse() {
+    return StoredResponse{409, "A request with this Idempotency-Key is still in progress", ""};
+}
+
+static StoredResponse unavailableResponse() {
+    return StoredResponse{503, "Idempotency-Key could not be checked, retry later", ""};
+}
+
+// How long a duplicate holds a handler thread waiting for the request it
+// repeats; past that it gets a 409 and the client can retry later
+static const std::chrono::seconds kDuplicateWait(2);
+
+// How long a duplicate waits for a request running in another process; the
+// same bound as a duplicate in this process
+static const std::chrono::seconds kClaimWait(2);
+static const std::chrono::milliseconds kClaimPollInterval(25);
+
+// Claims are taken over after a minute without renewal (see Database), so
+// a live owner renews several times within that
+static const std::chrono::seconds kClaimRenewInterval(15);
+
+// Attempts to save a completed response before handing it to the renewer
+static const int kSaveAttempts = 3;
+static const std::chrono::milliseconds kSaveRetryDelay(50);
+
+IdempotencyStore::IdempotencyStore(Database* database, size_t capacity, std::chrono::seconds time_to_live)
+    : db(database), shard_capacity(capacity / kShardCount + 1), ttl(time_to_live) {
+    if (db) {
+        renewer = std::thread(&IdempotencyStore::renewClaims, this);
+    }
+}
+
+IdempotencyStore::~IdempotencyStore() {
+    {
+        std::lock_guard<std::mutex> lock(claims_mutex);
+        stopping = true;
+        for (const auto& unsaved : unsaved_records) {
+            std::cerr << "CRITICAL: idempotency response for key " << unsaved.first
+                      << " was never saved; its claim can be taken over once it is a minute old" << std::endl;
+        }
+    }
+    claims_changed.notify_all();
+    if (renewer.joinable()) {
+        renewer.join();
+    }
+}
+
+void IdempotencyStore::holdClaim(const std::string& key) {
+    std::lock_guard<std::mutex> lock(claims_mutex);
+    claimed_keys.insert(key);
+}
+
+void IdempotencyStore::dropClaim(const std::string& key) {
+    std::lock_guard<std::mutex> lock(claims_mutex);
+    claimed_keys.erase(key);
+}
+
+bool IdempotencyStore::save(const IdempotencyRecord& record) {
+    for (int attempt = 1; attempt <= kSaveAttempts; ++attempt) {
+        if (db->saveIdempotencyRecord(record)) {
+            return true;
+        }
+        if (attempt < kSaveAttempts) {
+            std::this_thread::sleep_for(kSaveRetryDelay * attempt);
+        }
+    }
+    return false;
+}
+
+void IdempotencyStore::renewClaims() {
+    std::unique_lock<std::mutex> lock(claims_mutex);
+    while (!stopping) {
+        claims_changed.wait_for(lock, kClaimRenewInterval, [this] { return stopping; });
+        if (stopping || claimed_keys.empty()) {
+            continue;
+        }
+        std::vector<std::string> keys(claimed_keys.begin(), claimed_keys.end());
+        std::vector<IdempotencyRecord> unsaved;
+        for (const auto& entry : unsaved_records) {
+            unsaved.push_back(entry.second);
+        }
+        lock.unlock();
+        db->renewIdempotencyClaims(keys);
+        
+        // A saved record completes its claim, which then needs no renewing
+        std::vector<std::string> saved;
+        for (const auto& record : unsaved) {
+            if (db->saveIdempotencyRecord(record)) {
+                std::cerr << "Saved idempotency response for key " << record.key << " after earlier failures" << std::endl;
+                saved.push_back(record.key);
+            }
+        }
+        lock.lock();
+        for (const auto& key : saved) {
+            unsaved_records.erase(key);
+            claimed_keys.erase(key);
+        }
+    }
+}
+
+std::string IdempotencyStore::fingerprint(const std::string& body) {
+    // FNV-1a: stable across builds and processes, unlike std::hash, which
+    // matters because fingerprints are persisted
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : body) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    
+    char buffer[17];
+    std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(hash));
+    return buffer;
+}
+
+IdempotencyStore::Shard& IdempotencyStore::shardFor(const std::string& key) {
+    return shards[std::hash<std::string>{}(key) % kShardCount];
+}
+
+void IdempotencyStore::evict(Shard& shard) {
+    // Oldest completed entries go first; in-flight entries are never evicted
+    auto it = shard.lru.end();
+    while (shard.entries.size() > shard_capacity && it != shard.lru.begin()) {
+        --it;
+        auto entry = shard.entries.find(*it);
+        if (entry != shard.entries.end() && entry->second.completed) {
+            shard.entries.erase(entry);
+            it = shard.lru.erase(it);
+        }
+    }
+}
+
+void IdempotencyStore::finish(const std::string& key, const std::string& fingerprint, bool keep) {
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.entries.find(key);
+    if (it == shard.entries.end()) {
+        return;
+    }
+    
+    if (keep) {
+        it->second.fingerprint = fingerprint;
+        it->second.completed = true;
+    } else {
+        shard.lru.erase(it->second.lru_position);
+        shard.entries.erase(it);
+    }
+}
+
+StoredResponse IdempotencyStore::execute(const std::string& key, const std::string& fingerprint,
+                                         const std::function<StoredResponse()>& handler, bool& replayed) {
+    replayed = false;
+    Shard& shard = shardFor(key);
+    std::promise<StoredResponse> promise;
+    std::shared_future<StoredResponse> existing;
+    
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end() && it->second.completed && Clock::now() - it->second.created_at > ttl) {
+            shard.lru.erase(it->second.lru_position);
+            shard.entries.erase(it);
+            it = shard.entries.end();
+        }
+        
+        if (it != shard.entries.end()) {
+            if (it->second.fingerprint != fingerprint) {
+                return mismatchResponse();
+            }
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru_position);
+            existing = it->second.result;
+        } else {
+            shard.lru.push_front(key);
+            shard.entries[key] = Entry{fingerprint, promise.get_future().share(), false, Clock::now(), shard.lru.begin()};
+            evict(shard);
+        }
+    }
+    
+    // Repeated key: wait for (or reuse) the first request's response. It is
+    // a replay only if that response was kept, not a 409 or 5xx passed on.
+    if (existing.valid()) {
+        if (existing.wait_for(kDuplicateWait) != std::future_status::ready) {
+            return inProgressResponse();
+        }
+        StoredResponse response = existing.get();
+        replayed = response.stored;
+        return response;
+    }
+    
+    // Not seen by this process. Claim the key in the database so another
+    // server process (or this one after a restart) cannot run it too; if the
+    // claim is taken, wait for that request's response instead
+    if (db) {
+        ClaimResult claim = db->claimIdempotencyKey(key, fingerprint);
+        IdempotencyRecord record;
+        auto deadline = Clock::now() + kClaimWait;
+        while (claim == ClaimResult::Taken) {
+            if (db->findIdempotencyRecord(key, record) && (record.status_code != 0 || record.fingerprint != fingerprint)) {
+                break;
+            }
+            // The owner failed and released the key, or abandoned its claim
+            claim = db->claimIdempotencyKey(key, fingerprint);
+            if (claim == ClaimResult::Taken && Clock::now() >= deadline) {
+                promise.set_value(inProgressResponse());
+                finish(key, fingerprint, false);
+                return inProgressResponse();
+            }
+            if (claim == ClaimResult::Taken) {
+                std::this_thread::sleep_for(kClaimPollInterval);
+            }
+        }
+        
+        if (claim == ClaimResult::Unavailable) {
+            promise.set_value(unavailableResponse());
+            finish(key, fingerprint, false);
+            return unavailableResponse();
+        }
+        
+        if (claim == ClaimResult::Taken) {
+            // Still running elsewhere, for a different request
+            if (record.status_code == 0) {
+                promise.set_value(mismatchResponse());
+                finish(key, fingerprint, false);
+                return mismatchResponse();
+            }
+            
+            StoredResponse stored{record.status_code, record.body, record.content_type};
+            stored.stored = true;
+            promise.set_value(stored);
+            finish(key, record.fingerprint, true);
+            
+            if (record.fingerprint != fingerprint) {
+                return mismatchResponse();
+            }
+            replayed = true;
+            return stored;
+        }
+        holdClaim(key);
+    }
+    
+    StoredResponse response;
+    try {
+        response = handler();
+    } catch (const std::exception& e) {
+        std::cerr << "Idempotent handler error: " << e.what() << std::endl;
+        response = StoredResponse{500, "Internal server error", ""};
+    } catch (...) {
+        response = StoredResponse{500, "Internal server error", ""};
+    }
+    
+    bool keep = response.status < 500 && !response.transient;
+    if (keep && db) {
+        IdempotencyRecord completed{key, fingerprint, response.status, response.body, response.content_type};
+        if (save(completed)) {
+            dropClaim(key);
+        } else {
+            // The handler's effects are done; the claim must never become
+            // claimable again, so it stays held and renewed until a save lands
+            std::cerr << "CRITICAL: could not save idempotency response for key " << key
+                      << " (status " << response.status << "); keeping its claim and retrying" << std::endl;
+            std::lock_guard<std::mutex> lock(claims_mutex);
+            unsaved_records[key] = completed;
+        }
+    } else if (db) {
+        db->releaseIdempotencyKey(key);
+        dropClaim(key);
+    }
+    response.stored = keep;
+    promise.set_value(response);
+    finish(key, fingerprint, keep);
+    return response;
+}
@@ -1,21 +1,75 @@
 #include <crow.h>
+#include <openssl/rand.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
+#include <thread>
 #include <mongocxx/instance.hpp>
+#include "auth.h"
 #include "database.h"
+#include "idempotency.h"
 #include "routes.h"
+#include "server_stats.h"
+#include "shared_listener.h"
+#include "supervisor.h"
+#include "velocity.h"
 
-int main() {
+static const uint16_t kPort = 8080;
+
+// Handler threads per worker process; handlers block on MongoDB round trips
+static const unsigned kWorkerThreads = 4;
+
+// How long a stopping server waits for in-flight requests, and how long no
+// request must be in flight before it considers itself drained
+static const std::chrono::seconds kDrainTimeout(10);
+static const std::chrono::milliseconds kDrainQuietPeriod(250);
+
+static std::string randomSecret() {
+    unsigned char buffer[32];
+    RAND_bytes(buffer, sizeof(buffer));
+    
+    std::stringstream ss;
+    for (size_t i = 0; i < sizeof(buffer); i++) {
+        ss << std::hex << std::setw(2) << std::setfill('0') << (int)buffer[i];
+    }
+    return ss.str();
+}
+
+// One server process: its own MongoDB pool, caches and Crow app; velocity
+// counters are in velocity_table when workers share one. Returns after
+// SIGTERM or SIGINT, once it has stopped accepting connections and
+// in-flight requests have finished.
+static int runServer(unsigned threads, ServerStats* stats, WorkerSlot& slot, VelocityTable* velocity_table) {
     // Initialize MongoDB driver
     mongocxx::instance inst{};
     
-    // Create database connection
+    // Create database connection pool
     Database database;
     
+    // Velocity limits: built-in defaults unless BANKING_VELOCITY_RULES names a rules file
+    std::vector<VelocityRule> velocity_rules = VelocityEngine::defaultRules();
+    const char* rules_path = std::getenv("BANKING_VELOCITY_RULES");
+    if (rules_path && !VelocityEngine::loadRules(rules_path, velocity_rules)) {
+        return 1;
+    }
+    VelocityEngine velocity(velocity_rules, velocity_table);
+    size_t replayed = velocity.rebuild(&database);
+    std::cout << "Velocity engine loaded " << velocity_rules.size() << " rules, replayed "
+              << replayed << " recent transfers" << std::endl;
+    
+    // Idempotency-Key responses, backed by the idempotency_keys TTL collection
+    IdempotencyStore idempotency(&database);
+    
     // Create routes handler
-    Routes routes(&database);
+    Routes routes(&database, &velocity, &idempotency, stats);
     
     // Create Crow app
-    crow::SimpleApp app;
+    BankingApp app;
     
     // Enable CORS
     app.get_middleware<crow::CORSHandler>().global()
@@ -23,6 +77,8 @@ int main() {
         .methods("POST"_method, "GET"_method, "PUT"_method, "DELETE"_method)
         .origin("*");
     
+    app.get_middleware<RequestMetrics>().slot = &slot;
+    
     // Setup routes
     routes.setupRoutes(app);
     
@@ -32,8 +88,97 @@ int main() {
         return crow::load_text("../frontend/index.html");
     });
     
-    std::cout << "Banking System Server starting on port 8080..." << std::endl;
-    app.port(8080).multithreaded().run();
+    // Handle SIGTERM/SIGINT here rather than in Crow so the server can drain.
+    // Blocked before Crow starts its threads, so they inherit the mask.
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGTERM);
+    sigaddset(&stop_signals, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+    app.signal_clear();
+    
+    auto server = app.port(kPort).concurrency(static_cast<uint16_t>(std::max(1u, threads))).run_async();
+    app.wait_for_server_start();
+    slot.state = static_cast<uint32_t>(WorkerState::Ready);
+    
+    int signal_number = 0;
+    sigwait(&stop_signals, &signal_number);
+    slot.state = static_cast<uint32_t>(WorkerState::Draining);
+    
+    // Stop accepting first so new connections go to the other workers. Open
+    // keep-alive connections are still served, with Connection: close on
+    // every response, until none has had a request in flight for a while;
+    // only then does stop() close what is left.
+    SharedListener::stopAccepting();
+    auto now = std::chrono::steady_clock::now();
+    auto deadline = now + kDrainTimeout;
+    auto idle_since = now;
+    uint64_t handled = slot.requests.load();
+    while (now < deadline && now - idle_since < kDrainQuietPeriod) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        now = std::chrono::steady_clock::now();
+        // Counting completed requests too catches any that began and ended between samples
+        uint64_t current = slot.requests.load();
+        if (slot.in_flight.load() > 0 || current != handled) {
+            idle_since = now;
+            handled = current;
+        }
+    }
+    app.stop();
+    server.wait();
     
     return 0;
 }
+
+int main(int argc, char** argv) {
+    // Without --workers the server is a single multithreaded process
+    long workers = -1;
+    unsigned threads = 0;
+    bool pin_cpus = true;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--workers" && i + 1 < argc) {
+            workers = std::atol(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = static_cast<unsigned>(std::atoi(argv[++i]));
+        } else if (arg == "--no-pin") {
+            pin_cpus = false;
+        } else {
+            std::cerr << "Usage: banking_server [--workers N (0 = one per CPU)] [--threads N] [--no-pin]" << std::endl;
+            return 2;
+        }
+    }
+    
+    if (workers < 0) {
+        ServerStats* stats = ServerStats::create(1, 1, false);
+        WorkerSlot* slot = stats->acquire(0, 0);
+        slot->pid = getpid();
+        
+        std::cout << "Banking System Server starting on port " << kPort << "..." << std::endl;
+        return runServer(threads ? threads : std::thread::hardware_concurrency(), stats, *slot, nullptr);
+    }
+    
+    SupervisorOptions options;
+    options.workers = workers > 0 ? static_cast<size_t>(workers) : std::max<size_t>(1, Supervisor::availableCpus().size());
+    options.pin_cpus = pin_cpus;
+    
+    // Any worker may receive the next request, so tokens are signed with a
+    // secret shared by all workers instead of kept per process
+    const char* secret = std::getenv("BANKING_TOKEN_SECRET");
+    Auth::setTokenSecret(secret && *secret ? secret : randomSecret());
+    SharedListener::enableReusePort();
+    
+    // Twice the slots so replacements can start before old workers stop
+    ServerStats* stats = ServerStats::create(options.workers * 2, options.workers, true);
+    
+    // One set of velocity counters for all workers, so a limit holds however
+    // the kernel spreads a client's connections; it also survives restarts
+    VelocityTable* velocity_table = VelocityEngine::createTable(VelocityEngine::kDefaultTableKeys, true);
+    
+    std::cout << "Banking System Server starting on port " << kPort << " with "
+              << options.workers << " worker processes..." << std::endl;
+    Supervisor supervisor(options, stats, [&](WorkerSlot& slot) {
+        return runServer(threads ? threads : kWorkerThreads, stats, slot, velocity_table);
+    });
+    return supervisor.run();
+}
@@ -0,0 +1,225 @@
+#include "memory_database.h"
+#include "rollups.h"
+#include <cstdio>
+
+MemoryDatabase::MemoryDatabase() : Database(Unconnected{}) {}
+
+std::string MemoryDatabase::nextId() {
+    // Same shape as a MongoDB ObjectId so clients can't tell the difference
+    char buffer[25];
+    std::snprintf(buffer, sizeof(buffer), "%024llx", next_id++);
+    return buffer;
+}
+
+bool MemoryDatabase::createUser(const User& user) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (user_ids_by_username.count(user.username)) {
+        return false;
+    }
+    
+    User stored = user;
+    stored.id = nextId();
+    user_ids_by_username[stored.username] = stored.id;
+    users[stored.id] = stored;
+    return true;
+}
+
+User MemoryDatabase::getUserByUsername(const std::string& username) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = user_ids_by_username.find(username);
+    if (it == user_ids_by_username.end()) {
+        return User{};
+    }
+    return users[it->second];
+}
+
+User MemoryDatabase::getUserById(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = users.find(id);
+    return it != users.end() ? it->second : User{};
+}
+
+bool MemoryDatabase::createAccount(const Account& account) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (account_ids_by_number.count(account.account_number)) {
+        return false;
+    }
+    
+    Account stored = account;
+    stored.id = nextId();
+    account_ids_by_number[stored.account_number] = stored.id;
+    accounts[stored.id] = stored;
+    return true;
+}
+
+std::vector<Account> MemoryDatabase::getAccountsByUserId(const std::string& user_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Account> result;
+    for (const auto& entry : accounts) {
+        if (entry.second.user_id == user_id) {
+            result.push_back(entry.second);
+        }
+    }
+    return result;
+}
+
+Account MemoryDatabase::getAccountById(const std::string& account_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = accounts.find(account_id);
+    return it != accounts.end() ? it->second : Account{};
+}
+
+Account MemoryDatabase::getAccountByNumber(const std::string& account_number) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = account_ids_by_number.find(account_number);
+    if (it == account_ids_by_number.end()) {
+        return Account{};
+    }
+    return accounts[it->second];
+}
+
+bool MemoryDatabase::updateAccountBalance(const std::string& account_id, double new_balance) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = accounts.find(account_id);
+    if (it == accounts.end()) {
+        return false;
+    }
+    it->second.balance = new_balance;
+    return true;
+}
+
+void MemoryDatabase::forEachAccount(const std::function<void(const Account&)>& callback) {
+    std::vector<Account> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& entry : accounts) {
+            snapshot.push_back(entry.second);
+        }
+    }
+    for (const auto& account : snapshot) {
+        callback(account);
+    }
+}
+
+bool MemoryDatabase::createTransaction(Transaction& transaction) {
+    std::lock_guard<std::mutex> lock(mutex);
+    transaction.id = nextId();
+    Transaction stored = transaction;
+    
+    size_t index = transactions.size();
+    transactions.push_back(stored);
+    transactions_by_account[stored.from_account].push_back(index);
+    if (stored.to_account != stored.from_account) {
+        transactions_by_account[stored.to_account].push_back(index);
+    }
+    return true;
+}
+
+std::vector<Transaction> MemoryDatabase::getTransactionsByAccountId(const std::string& account_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Transaction> result;
+    auto it = transactions_by_account.find(account_id);
+    if (it != transactions_by_account.end()) {
+        for (size_t index : it->second) {
+            result.push_back(transactions[index]);
+        }
+    }
+    return result;
+}
+
+std::vector<Transaction> MemoryDatabase::getTransactionsSince(const std::string& timestamp) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Transaction> result;
+    for (const auto& transaction : transactions) {
+        if (transaction.timestamp >= timestamp) {
+            result.push_back(transaction);
+        }
+    }
+    return result;
+}
+
+// Rollups are keyed "<account>|<granularity>|<period>" so each account's
+// periods sit next to each other in period order
+bool MemoryDatabase::applyTransactionRollups(const Transaction& transaction, double from_balance, double to_balance) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const std::string granularity : {"day", "month"}) {
+        std::string period = Rollups::periodKey(transaction.timestamp, granularity);
+        
+        AccountRollup& debit = rollups[transaction.from_account + "|" + granularity + "|" + period];
+        if (debit.period.empty()) {
+            debit = AccountRollup{transaction.from_account, granularity, period, 0, 0.0, 0.0, 0.0};
+        }
+        debit.count++;
+        debit.debits += transaction.amount;
+        debit.closing_balance = from_balance;
+        
+        AccountRollup& credit = rollups[transaction.to_account + "|" + granularity + "|" + period];
+        if (credit.period.empty()) {
+            credit = AccountRollup{transaction.to_account, granularity, period, 0, 0.0, 0.0, 0.0};
+        }
+        credit.count++;
+        credit.credits += transaction.amount;
+        credit.closing_balance = to_balance;
+    }
+    return true;
+}
+
+std::vector<AccountRollup> MemoryDatabase::getAccountRollups(const std::string& account_id, const std::string& granularity) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<AccountRollup> result;
+    std::string prefix = account_id + "|" + granularity + "|";
+    for (auto it = rollups.lower_bound(prefix); it != rollups.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it) {
+        result.push_back(it->second);
+    }
+    return result;
+}
+
+bool MemoryDatabase::replaceAccountRollups(const std::string& account_id, const std::vector<AccountRollup>& replacement) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string prefix = account_id + "|";
+    auto it = rollups.lower_bound(prefix);
+    while (it != rollups.end() && it->first.compare(0, prefix.size(), prefix) == 0) {
+        it = rollups.erase(it);
+    }
+    for (const auto& rollup : replacement) {
+        rollups[rollup.account_id + "|" + rollup.granularity + "|" + rollup.period] = rollup;
+    }
+    return true;
+}
+
+ClaimResult MemoryDatabase::claimIdempotencyKey(const std::string& key, const std::string& fingerprint) {
+    std::lock_guard<std::mutex> lock(mutex);
+    bool inserted = idempotency_records.emplace(key, IdempotencyRecord{key, fingerprint, 0, "", ""}).second;
+    return inserted ? ClaimResult::Claimed : ClaimResult::Taken;
+}
+
+// Claims here are never taken over, so there is nothing to renew
+bool MemoryDatabase::renewIdempotencyClaims(const std::vector<std::string>&) {
+    return true;
+}
+
+bool MemoryDatabase::findIdempotencyRecord(const std::string& key, IdempotencyRecord& record) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = idempotency_records.find(key);
+    if (it == idempotency_records.end()) {
+        return false;
+    }
+    record = it->second;
+    return true;
+}
+
+bool MemoryDatabase::saveIdempotencyRecord(const IdempotencyRecord& record) {
+    std::lock_guard<std::mutex> lock(mutex);
+    idempotency_records[record.key] = record;
+    return true;
+}
+
+bool MemoryDatabase::releaseIdempotencyKey(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = idempotency_records.find(key);
+    if (it == idempotency_records.end() || it->second.status_code != 0) {
+        return false;
+    }
+    idempotency_records.erase(it);
+    return true;
+}
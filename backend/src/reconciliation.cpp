@@ -0,0 +1,627 @@
+#include "reconciliation.h"
+#include "thread_pool.h"
+#include "utils.h"
+#include <mongocxx/client.hpp>
+#include <mongocxx/pool.hpp>
+#include <mongocxx/uri.hpp>
+#include <mongocxx/options/find.hpp>
+#include <bsoncxx/builder/stream/document.hpp>
+#include <bsoncxx/builder/stream/array.hpp>
+#include <bsoncxx/oid.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+using bsoncxx::builder::stream::document;
+using bsoncxx::builder::stream::open_document;
+using bsoncxx::builder::stream::close_document;
+using bsoncxx::builder::stream::open_array;
+using bsoncxx::builder::stream::close_array;
+using bsoncxx::builder::stream::finalize;
+
+// Transactions created in the last few seconds are left to the next run.
+// ObjectIds come from client clocks, so this also absorbs clock skew
+// between application servers.
+static const uint32_t kSnapshotLagSeconds = 5;
+
+// Mismatched accounts carried over in the watermark for the next run
+static const size_t kMaxOpenAccounts = 10000;
+
+static const int32_t kCursorBatchSize = 10000;
+
+// Accounts are referenced by their ObjectId hex string; keying the
+// aggregates by the 12 raw bytes keeps them allocation-free
+struct AccountKey {
+    uint64_t high;
+    uint32_t low;
+    
+    bool operator==(const AccountKey& other) const {
+        return high == other.high && low == other.low;
+    }
+};
+
+struct AccountKeyHash {
+    size_t operator()(const AccountKey& key) const {
+        uint64_t h = key.high ^ (static_cast<uint64_t>(key.low) * 0x9E3779B97F4A7C15ULL);
+        h ^= h >> 31;
+        h *= 0xBF58476D1CE4E5B9ULL;
+        h ^= h >> 29;
+        return static_cast<size_t>(h);
+    }
+};
+
+// Amounts are summed in integer cents so totals over millions of
+// transactions are exact
+struct LedgerTotals {
+    int64_t credits = 0;
+    int64_t debits = 0;
+    int64_t count = 0;
+    bool seen = false;
+};
+
+using LedgerMap = std::unordered_map<AccountKey, LedgerTotals, AccountKeyHash>;
+
+struct TransactionScan {
+    LedgerMap totals;
+    std::unordered_map<std::string, LedgerTotals> malformed;   // references that are not ObjectIds
+    size_t scanned = 0;
+};
+
+struct AccountScan {
+    std::vector<AccountKey> candidates;
+    size_t checked = 0;
+    size_t unverifiable = 0;
+};
+
+// One _id range; a missing bound is open
+struct IdRange {
+    bool has_lower = false;
+    bool has_upper = false;
+    bsoncxx::oid lower;
+    bsoncxx::oid upper;
+};
+
+static bool parseKey(const std::string& hex, AccountKey& key) {
+    if (hex.size() != 24) {
+        return false;
+    }
+    uint8_t bytes[12];
+    for (size_t i = 0; i < 12; ++i) {
+        int value = 0;
+        for (size_t j = 0; j < 2; ++j) {
+            char c = hex[i * 2 + j];
+            int digit;
+            if (c >= '0' && c <= '9') {
+                digit = c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                digit = c - 'a' + 10;
+            } else if (c >= 'A' && c <= 'F') {
+                digit = c - 'A' + 10;
+            } else {
+                return false;
+            }
+            value = value * 16 + digit;
+        }
+        bytes[i] = static_cast<uint8_t>(value);
+    }
+    
+    key.high = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        key.high = (key.high << 8) | bytes[i];
+    }
+    key.low = (static_cast<uint32_t>(bytes[8]) << 24) | (static_cast<uint32_t>(bytes[9]) << 16) |
+              (static_cast<uint32_t>(bytes[10]) << 8) | bytes[11];
+    return true;
+}
+
+static AccountKey keyFromOid(const bsoncxx::oid& id) {
+    AccountKey key{};
+    parseKey(id.to_string(), key);
+    return key;
+}
+
+static std::string keyToString(const AccountKey& key) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(24, '0');
+    for (int i = 0; i < 16; ++i) {
+        hex[i] = digits[(key.high >> (60 - i * 4)) & 0xF];
+    }
+    for (int i = 0; i < 8; ++i) {
+        hex[16 + i] = digits[(key.low >> (28 - i * 4)) & 0xF];
+    }
+    return hex;
+}
+
+// Which hash pass an account belongs to; uses different bits than the
+// map's bucket index
+static size_t passOf(const AccountKey& key, size_t passes) {
+    return (AccountKeyHash{}(key) >> 32) % passes;
+}
+
+static int64_t toCents(double amount) {
+    return std::llround(amount * 100.0);
+}
+
+static double numericValue(const bsoncxx::document::element& element) {
+    switch (element.type()) {
+        case bsoncxx::type::k_double:
+            return element.get_double().value;
+        case bsoncxx::type::k_int32:
+            return element.get_int32().value;
+        case bsoncxx::type::k_int64:
+            return static_cast<double>(element.get_int64().value);
+        default:
+            return 0.0;
+    }
+}
+
+static std::string stringValue(const bsoncxx::document::element& element) {
+    if (element && element.type() == bsoncxx::type::k_utf8) {
+        return element.get_utf8().value.to_string();
+    }
+    return "";
+}
+
+// The smallest ObjectId generated at the given second
+static bsoncxx::oid oidAt(uint32_t seconds) {
+    char bytes[12] = {0};
+    bytes[0] = static_cast<char>(seconds >> 24);
+    bytes[1] = static_cast<char>(seconds >> 16);
+    bytes[2] = static_cast<char>(seconds >> 8);
+    bytes[3] = static_cast<char>(seconds);
+    return bsoncxx::oid(bytes, sizeof(bytes));
+}
+
+static uint32_t oidSeconds(const bsoncxx::oid& id) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(id.bytes());
+    return (static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16) |
+           (static_cast<uint32_t>(bytes[2]) << 8) | bytes[3];
+}
+
+// Splits [lower, upper) into equal time slices by ObjectId timestamp. The
+// first slice is open below and, when open_ended is set, the last is open
+// above, so every document of the collection falls in exactly one slice.
+static std::vector<IdRange> splitRange(uint32_t lower, uint32_t upper, size_t count, bool open_ended) {
+    std::vector<IdRange> ranges;
+    if (upper <= lower) {
+        upper = lower + 1;
+    }
+    count = std::max<size_t>(1, std::min<size_t>(count, upper - lower));
+    uint64_t span = upper - lower;
+    for (size_t i = 0; i < count; ++i) {
+        IdRange range;
+        if (i > 0) {
+            range.has_lower = true;
+            range.lower = oidAt(static_cast<uint32_t>(lower + span * i / count));
+        }
+        if (i + 1 < count || !open_ended) {
+            range.has_upper = true;
+            range.upper = oidAt(static_cast<uint32_t>(lower + span * (i + 1) / count));
+        }
+        ranges.push_back(range);
+    }
+    return ranges;
+}
+
+static bsoncxx::document::value rangeFilter(const IdRange& range) {
+    auto bounds = document{};
+    if (range.has_lower) {
+        bounds << "$gte" << range.lower;
+    }
+    if (range.has_upper) {
+        bounds << "$lt" << range.upper;
+    }
+    if (!range.has_lower && !range.has_upper) {
+        return document{} << finalize;
+    }
+    return document{} << "_id" << bsoncxx::types::b_document{bounds.view()} << finalize;
+}
+
+// Timestamp of the oldest document in a collection, or `fallback` if empty
+static uint32_t oldestSeconds(mongocxx::collection collection, uint32_t fallback) {
+    mongocxx::options::find options;
+    options.sort(document{} << "_id" << 1 << finalize);
+    options.projection(document{} << "_id" << 1 << finalize);
+    auto oldest = collection.find_one(document{} << finalize, options);
+    return oldest ? oidSeconds(oldest->view()["_id"].get_oid().value) : fallback;
+}
+
+static void addReference(TransactionScan& scan, const std::string& account_id, int64_t cents, bool credit,
+                         size_t pass, size_t passes) {
+    // "" is the outside world (interest, fees)
+    if (account_id.empty()) {
+        return;
+    }
+    
+    AccountKey key;
+    LedgerTotals* totals;
+    if (parseKey(account_id, key)) {
+        if (passOf(key, passes) != pass) {
+            return;
+        }
+        totals = &scan.totals[key];
+    } else if (pass == 0) {
+        totals = &scan.malformed[account_id];
+    } else {
+        return;
+    }
+    
+    if (credit) {
+        totals->credits += cents;
+    } else {
+        totals->debits += cents;
+    }
+    totals->count++;
+}
+
+static TransactionScan scanTransactions(mongocxx::pool& pool, const IdRange& range, size_t pass, size_t passes) {
+    TransactionScan scan;
+    auto client = pool.acquire();
+    auto transactions = (*client)["banking_system"]["transactions"];
+    
+    mongocxx::options::find options;
+    options.projection(document{} << "from_account" << 1 << "to_account" << 1
+                                  << "amount" << 1 << "status" << 1 << finalize);
+    options.batch_size(kCursorBatchSize);
+    
+    for (auto&& doc : transactions.find(rangeFilter(range).view(), options)) {
+        scan.scanned++;
+        if (stringValue(doc["status"]) != "completed") {
+            continue;
+        }
+        int64_t cents = toCents(numericValue(doc["amount"]));
+        addReference(scan, stringValue(doc["from_account"]), cents, false, pass, passes);
+        addReference(scan, stringValue(doc["to_account"]), cents, true, pass, passes);
+    }
+    return scan;
+}
+
+// Scans the ranges with at most one scan per worker in flight and merges
+// each result as soon as it completes, oldest first, so memory holds the
+// merged totals plus a worker's worth of partial ones however many
+// partitions there are
+static void scanRanges(mongocxx::pool& pool, ThreadPool& workers, const std::vector<IdRange>& ranges,
+                       size_t pass, size_t passes, const std::function<void(const TransactionScan&)>& merge) {
+    std::deque<std::future<TransactionScan>> in_flight;
+    size_t next = 0;
+    while (next < ranges.size() || !in_flight.empty()) {
+        while (next < ranges.size() && in_flight.size() < workers.size()) {
+            const IdRange& range = ranges[next++];
+            in_flight.push_back(workers.submit([&pool, &range, pass, passes]() {
+                return scanTransactions(pool, range, pass, passes);
+            }));
+        }
+        TransactionScan scan = in_flight.front().get();
+        in_flight.pop_front();
+        merge(scan);
+    }
+}
+
+static AccountScan checkAccounts(mongocxx::pool& pool, const IdRange& range, size_t pass, size_t passes,
+                                 LedgerMap& ledger) {
+    AccountScan scan;
+    auto client = pool.acquire();
+    auto accounts = (*client)["banking_system"]["accounts"];
+    
+    mongocxx::options::find options;
+    options.projection(document{} << "balance" << 1 << "opening_balance" << 1 << finalize);
+    options.batch_size(kCursorBatchSize);
+    
+    for (auto&& doc : accounts.find(rangeFilter(range).view(), options)) {
+        AccountKey key = keyFromOid(doc["_id"].get_oid().value);
+        if (passOf(key, passes) != pass) {
+            continue;
+        }
+        scan.checked++;
+        
+        // Each account lives in exactly one range, so concurrent scans
+        // only ever touch different entries of the shared map
+        int64_t credits = 0;
+        int64_t debits = 0;
+        auto totals = ledger.find(key);
+        if (totals != ledger.end()) {
+            totals->second.seen = true;
+            credits = totals->second.credits;
+            debits = totals->second.debits;
+        }
+        
+        if (!doc["opening_balance"]) {
+            scan.unverifiable++;
+            continue;
+        }
+        int64_t expected = toCents(numericValue(doc["opening_balance"])) + credits - debits;
+        if (toCents(numericValue(doc["balance"])) != expected) {
+            scan.candidates.push_back(key);
+        }
+    }
+    return scan;
+}
+
+enum class AccountStatus { Balanced, Mismatched, Orphaned, Unverifiable };
+
+// Checks one account directly through the from_account/to_account indexes
+static AccountStatus verifyAccount(mongocxx::database& db, const AccountKey& key,
+                                   BalanceMismatch& mismatch, OrphanedReference& orphan) {
+    std::string account_id = keyToString(key);
+    auto account = db["accounts"].find_one(document{} << "_id" << bsoncxx::oid{account_id} << finalize);
+    
+    auto filter = document{} << "status" << "completed"
+                            << "$or" << open_array
+                            << open_document << "from_account" << account_id << close_document
+                            << open_document << "to_account" << account_id << close_document
+                            << close_array << finalize;
+    mongocxx::options::find options;
+    options.projection(document{} << "from_account" << 1 << "to_account" << 1 << "amount" << 1 << finalize);
+    
+    int64_t net = 0;
+    int64_t moved = 0;
+    long long count = 0;
+    for (auto&& doc : db["transactions"].find(filter.view(), options)) {
+        int64_t cents = toCents(numericValue(doc["amount"]));
+        if (stringValue(doc["from_account"]) == account_id) {
+            net -= cents;
+        }
+        if (stringValue(doc["to_account"]) == account_id) {
+            net += cents;
+        }
+        moved += cents;
+        count++;
+    }
+    
+    if (!account) {
+        if (count == 0) {
+            return AccountStatus::Balanced;
+        }
+        orphan = OrphanedReference{account_id, count, moved / 100.0};
+        return AccountStatus::Orphaned;
+    }
+    
+    auto doc = account->view();
+    if (!doc["opening_balance"]) {
+        return AccountStatus::Unverifiable;
+    }
+    int64_t expected = toCents(numericValue(doc["opening_balance"])) + net;
+    int64_t balance = toCents(numericValue(doc["balance"]));
+    if (balance == expected) {
+        return AccountStatus::Balanced;
+    }
+    mismatch = BalanceMismatch{account_id, balance / 100.0, expected / 100.0, count};
+    return AccountStatus::Mismatched;
+}
+
+// Verifies accounts in parallel and records the findings in the report.
+// Returns the keys still mismatched.
+static std::vector<AccountKey> verifyAccounts(mongocxx::pool& pool, ThreadPool& workers,
+                                              const std::vector<AccountKey>& keys, size_t report_limit,
+                                              ReconcileReport& report, bool count_checked) {
+    std::mutex mutex;
+    std::vector<AccountKey> still_mismatched;
+    
+    workers.parallelFor(keys.size(), 64, [&](size_t begin, size_t end) {
+        auto client = pool.acquire();
+        auto db = (*client)["banking_system"];
+        for (size_t i = begin; i < end; ++i) {
+            BalanceMismatch mismatch;
+            OrphanedReference orphan;
+            AccountStatus status = verifyAccount(db, keys[i], mismatch, orphan);
+            
+            std::lock_guard<std::mutex> lock(mutex);
+            if (count_checked && status != AccountStatus::Orphaned) {
+                report.accounts_checked++;
+            }
+            if (status == AccountStatus::Mismatched) {
+                still_mismatched.push_back(keys[i]);
+                if (report.mismatches.size() < report_limit) {
+                    report.mismatches.push_back(mismatch);
+                }
+                report.mismatch_count++;
+            } else if (status == AccountStatus::Orphaned) {
+                if (report.orphans.size() < report_limit) {
+                    report.orphans.push_back(orphan);
+                }
+                report.orphan_count++;
+            } else if (status == AccountStatus::Unverifiable && count_checked) {
+                report.unverifiable++;
+            }
+        }
+    });
+    return still_mismatched;
+}
+
+static void recordOrphan(ReconcileReport& report, size_t report_limit, const std::string& account_id,
+                         const LedgerTotals& totals) {
+    if (report.orphans.size() < report_limit) {
+        report.orphans.push_back(OrphanedReference{account_id, totals.count,
+                                                   (totals.credits + totals.debits) / 100.0});
+    }
+    report.orphan_count++;
+}
+
+static bool saveWatermark(mongocxx::database& db, const bsoncxx::oid& cutoff,
+                          const std::vector<AccountKey>& open_accounts, const std::string& mode) {
+    try {
+        auto open = bsoncxx::builder::stream::array{};
+        for (size_t i = 0; i < open_accounts.size() && i < kMaxOpenAccounts; ++i) {
+            open << keyToString(open_accounts[i]);
+        }
+        
+        auto filter = document{} << "_id" << "ledger" << finalize;
+        auto update = document{} << "$set" << open_document
+                                << "cutoff" << cutoff
+                                << "open_accounts" << bsoncxx::types::b_array{open.view()}
+                                << "mode" << mode
+                                << "updated_at" << Utils::getCurrentTimestamp()
+                                << close_document << finalize;
+        mongocxx::options::update upsert;
+        upsert.upsert(true);
+        db["recon_watermarks"].update_one(filter.view(), update.view(), upsert);
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Error saving reconciliation watermark: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+static bool runFull(mongocxx::pool& pool, ThreadPool& workers, const ReconcileOptions& options,
+                    uint32_t cutoff_seconds, ReconcileReport& report) {
+    auto client = pool.acquire();
+    auto db = (*client)["banking_system"];
+    size_t partitions = options.partitions ? options.partitions : workers.size() * 4;
+    size_t passes = std::max<size_t>(1, options.passes);
+    
+    // Transactions stop at the snapshot cutoff; accounts are open-ended so
+    // every account a scanned transaction refers to is seen
+    uint32_t now = static_cast<uint32_t>(std::time(nullptr));
+    auto transaction_ranges = splitRange(oldestSeconds(db["transactions"], cutoff_seconds), cutoff_seconds,
+                                         partitions, false);
+    auto account_ranges = splitRange(oldestSeconds(db["accounts"], now), now, partitions, true);
+    
+    std::vector<AccountKey> candidates;
+    for (size_t pass = 0; pass < passes; ++pass) {
+        LedgerMap ledger;
+        std::unordered_map<std::string, LedgerTotals> malformed;
+        
+        scanRanges(pool, workers, transaction_ranges, pass, passes, [&](const TransactionScan& scan) {
+            report.transactions_scanned += pass == 0 ? scan.scanned : 0;
+            for (const auto& entry : scan.totals) {
+                LedgerTotals& totals = ledger[entry.first];
+                totals.credits += entry.second.credits;
+                totals.debits += entry.second.debits;
+                totals.count += entry.second.count;
+            }
+            for (const auto& entry : scan.malformed) {
+                LedgerTotals& totals = malformed[entry.first];
+                totals.credits += entry.second.credits;
+                totals.debits += entry.second.debits;
+                totals.count += entry.second.count;
+            }
+        });
+        
+        std::vector<std::future<AccountScan>> checks;
+        for (const auto& range : account_ranges) {
+            checks.push_back(workers.submit([&pool, &ledger, range, pass, passes]() {
+                return checkAccounts(pool, range, pass, passes, ledger);
+            }));
+        }
+        for (auto& pending : checks) {
+            AccountScan scan = pending.get();
+            report.accounts_checked += scan.checked;
+            report.unverifiable += scan.unverifiable;
+            candidates.insert(candidates.end(), scan.candidates.begin(), scan.candidates.end());
+        }
+        
+        // Referenced accounts the scan did not find are only orphan
+        // candidates until a point lookup confirms the account is gone
+        for (const auto& entry : ledger) {
+            if (!entry.second.seen) {
+                candidates.push_back(entry.first);
+            }
+        }
+        for (const auto& entry : malformed) {
+            recordOrphan(report, options.report_limit, entry.first, entry.second);
+        }
+        
+        if (passes > 1) {
+            std::cout << "Pass " << pass + 1 << "/" << passes << ": " << report.accounts_checked
+                      << " accounts checked" << std::endl;
+        }
+    }
+    
+    // The scan compared balances read after the cutoff against transactions
+    // before it; re-verify each candidate against its current state. Only
+    // what is still wrong then is reported.
+    auto mismatched = verifyAccounts(pool, workers, candidates, options.report_limit, report, false);
+    return saveWatermark(db, oidAt(cutoff_seconds), mismatched, "full");
+}
+
+static bool runIncremental(mongocxx::pool& pool, ThreadPool& workers, const ReconcileOptions& options,
+                           uint32_t cutoff_seconds, ReconcileReport& report) {
+    auto client = pool.acquire();
+    auto db = (*client)["banking_system"];
+    
+    auto watermark = db["recon_watermarks"].find_one(document{} << "_id" << "ledger" << finalize);
+    if (!watermark) {
+        std::cerr << "No reconciliation watermark found; run a full reconciliation first" << std::endl;
+        return false;
+    }
+    auto mark = watermark->view();
+    uint32_t since = oidSeconds(mark["cutoff"].get_oid().value);
+    if (cutoff_seconds <= since) {
+        cutoff_seconds = since;
+    }
+    
+    // Collect every account touched since the watermark
+    std::unordered_set<AccountKey, AccountKeyHash> touched;
+    std::unordered_map<std::string, LedgerTotals> malformed;
+    size_t partitions = options.partitions ? options.partitions : workers.size() * 4;
+    auto ranges = splitRange(since, cutoff_seconds, partitions, false);
+    ranges.front().has_lower = true;
+    ranges.front().lower = oidAt(since);
+    
+    scanRanges(pool, workers, ranges, 0, 1, [&](const TransactionScan& scan) {
+        report.transactions_scanned += scan.scanned;
+        for (const auto& entry : scan.totals) {
+            touched.insert(entry.first);
+        }
+        for (const auto& entry : scan.malformed) {
+            LedgerTotals& totals = malformed[entry.first];
+            totals.credits += entry.second.credits;
+            totals.debits += entry.second.debits;
+            totals.count += entry.second.count;
+        }
+    });
+    
+    // New accounts, even without transactions, must match their opening balance
+    mongocxx::options::find options_new;
+    options_new.projection(document{} << "_id" << 1 << finalize);
+    auto new_accounts = document{} << "_id" << open_document << "$gte" << oidAt(since) << close_document << finalize;
+    for (auto&& doc : db["accounts"].find(new_accounts.view(), options_new)) {
+        touched.insert(keyFromOid(doc["_id"].get_oid().value));
+    }
+    
+    if (mark["open_accounts"]) {
+        for (auto&& element : mark["open_accounts"].get_array().value) {
+            AccountKey key;
+            if (parseKey(element.get_utf8().value.to_string(), key)) {
+                touched.insert(key);
+            }
+        }
+    }
+    
+    for (const auto& entry : malformed) {
+        recordOrphan(report, options.report_limit, entry.first, entry.second);
+    }
+    
+    std::vector<AccountKey> keys(touched.begin(), touched.end());
+    auto mismatched = verifyAccounts(pool, workers, keys, options.report_limit, report, true);
+    return saveWatermark(db, oidAt(cutoff_seconds), mismatched, "incremental");
+}
+
+bool Reconciliation::run(const ReconcileOptions& options, ReconcileReport& report) {
+    auto start = std::chrono::steady_clock::now();
+    report.incremental = options.incremental;
+    uint32_t cutoff_seconds = static_cast<uint32_t>(std::time(nullptr)) - kSnapshotLagSeconds;
+    
+    bool ok;
+    try {
+        mongocxx::pool pool{mongocxx::uri{options.mongo_uri}};
+        ThreadPool workers(options.threads ? options.threads : std::thread::hardware_concurrency());
+        ok = options.incremental ? runIncremental(pool, workers, options, cutoff_seconds, report)
+                                 : runFull(pool, workers, options, cutoff_seconds, report);
+    } catch (const std::exception& e) {
+        std::cerr << "Reconciliation error: " << e.what() << std::endl;
+        return false;
+    }
+    
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return ok;
+}
@@ -0,0 +1,56 @@
+#include "rollups.h"
+#include <map>
+
+static const char* granularities[] = {"day", "month"};
+
+bool Rollups::isValidGranularity(const std::string& granularity) {
+    return granularity == "day" || granularity == "month";
+}
+
+std::string Rollups::periodKey(const std::string& timestamp, const std::string& granularity) {
+    return timestamp.substr(0, granularity == "day" ? 10 : 7);
+}
+
+std::vector<AccountRollup> Rollups::compute(const std::string& account_id,
+                                            const std::vector<Transaction>& transactions,
+                                            double current_balance) {
+    std::vector<AccountRollup> rollups;
+    
+    for (const char* granularity : granularities) {
+        std::map<std::string, AccountRollup> buckets;
+        for (const auto& transaction : transactions) {
+            if (transaction.status != "completed") {
+                continue;
+            }
+            
+            std::string period = periodKey(transaction.timestamp, granularity);
+            AccountRollup& bucket = buckets[period];
+            if (bucket.period.empty()) {
+                bucket = AccountRollup{account_id, granularity, period, 0, 0.0, 0.0, 0.0};
+            }
+            
+            // A self-transfer is both a debit and a credit, as it is when applied live
+            if (transaction.from_account == account_id) {
+                bucket.count++;
+                bucket.debits += transaction.amount;
+            }
+            if (transaction.to_account == account_id) {
+                bucket.count++;
+                bucket.credits += transaction.amount;
+            }
+        }
+        
+        // Walk newest to oldest, peeling each period's net change off the balance
+        double balance = current_balance;
+        for (auto it = buckets.rbegin(); it != buckets.rend(); ++it) {
+            it->second.closing_balance = balance;
+            balance -= it->second.credits - it->second.debits;
+        }
+        
+        for (auto& entry : buckets) {
+            rollups.push_back(entry.second);
+        }
+    }
+    
+    return rollups;
+}
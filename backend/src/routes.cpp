@@ -1,12 +1,41 @@
 #include "routes.h"
 #include "auth.h"
 #include "utils.h"
+#include "rollups.h"
 #include <crow/json.h>
 #include <iostream>
+#include <sstream>
 
-Routes::Routes(Database* database) : db(database) {}
+void RequestMetrics::before_handle(crow::request& req, crow::response& res, context& ctx) {
+    ctx.start = std::chrono::steady_clock::now();
+    if (slot) {
+        slot->in_flight++;
+    }
+}
 
-void Routes::setupRoutes(crow::SimpleApp& app) {
+void RequestMetrics::after_handle(crow::request& req, crow::response& res, context& ctx) {
+    if (!slot) {
+        return;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - ctx.start;
+    slot->in_flight--;
+    slot->requests++;
+    slot->latency_us += std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    if (res.code >= 500) {
+        slot->errors++;
+    }
+    // A draining worker no longer accepts connections; send keep-alive
+    // clients to reconnect, which lands them on another worker
+    if (slot->state.load() == static_cast<uint32_t>(WorkerState::Draining)) {
+        res.set_header("Connection", "close");
+    }
+}
+
+Routes::Routes(Database* database, VelocityEngine* velocity_engine, IdempotencyStore* idempotency_store,
+               ServerStats* server_stats)
+    : db(database), velocity(velocity_engine), idempotency(idempotency_store), stats(server_stats) {}
+
+void Routes::setupRoutes(BankingApp& app) {
     // Authentication routes
     CROW_ROUTE(app, "/api/login").methods("POST"_method)
     ([this](const crow::request& req) {
@@ -26,7 +55,14 @@ void Routes::setupRoutes(crow::SimpleApp& app) {
     
     CROW_ROUTE(app, "/api/accounts").methods("POST"_method)
     ([this](const crow::request& req) {
-        return this->handleCreateAccount(req);
+        return this->withIdempotency(req, "create_account", [this, &req]() {
+            return this->handleCreateAccount(req);
+        });
+    });
+    
+    CROW_ROUTE(app, "/api/accounts/<string>/summary").methods("GET"_method)
+    ([this](const crow::request& req, const std::string& account_id) {
+        return this->handleGetAccountSummary(account_id, req);
     });
     
     CROW_ROUTE(app, "/api/balance/<string>")
@@ -37,13 +73,65 @@ void Routes::setupRoutes(crow::SimpleApp& app) {
     // Transaction routes
     CROW_ROUTE(app, "/api/transfer").methods("POST"_method)
     ([this](const crow::request& req) {
-        return this->handleTransfer(req);
+        return this->withIdempotency(req, "transfer", [this, &req]() {
+            return this->handleTransfer(req);
+        });
     });
     
     CROW_ROUTE(app, "/api/transactions/<string>")
     ([this](const std::string& account_id, const crow::request& req) {
         return this->handleGetTransactions(account_id, req);
     });
+    
+    // Health and metrics, aggregated over all server processes
+    CROW_ROUTE(app, "/api/health").methods("GET"_method)
+    ([this](const crow::request& req) {
+        return this->handleHealth(req);
+    });
+    
+    CROW_ROUTE(app, "/metrics").methods("GET"_method)
+    ([this](const crow::request& req) {
+        return this->handleMetrics(req);
+    });
+}
+
+crow::response Routes::withIdempotency(const crow::request& req, const std::string& operation,
+                                       const std::function<crow::response()>& handler) {
+    std::string key = req.get_header_value("Idempotency-Key");
+    if (!idempotency || key.empty()) {
+        return handler();
+    }
+    if (key.size() > 255) {
+        return crow::response(400, "Idempotency-Key too long");
+    }
+    
+    // Keys are scoped per user and operation; unauthenticated requests
+    // go straight to the handler, which rejects them
+    std::string user_id;
+    if (!Auth::verifyToken(req.get_header_value("Authorization"), user_id)) {
+        return handler();
+    }
+    
+    bool replayed = false;
+    StoredResponse stored = idempotency->execute(user_id + ":" + operation + ":" + key,
+                                                 IdempotencyStore::fingerprint(req.body),
+                                                 [&handler]() {
+        crow::response res = handler();
+        StoredResponse response{res.code, res.body, res.get_header_value("Content-Type")};
+        // The only 403 these handlers return is a velocity rejection, which
+        // lifts once the window passes; a retry with the same key must run again
+        response.transient = res.code == 403;
+        return response;
+    }, replayed);
+    
+    crow::response res(stored.status, stored.body);
+    if (!stored.content_type.empty()) {
+        res.set_header("Content-Type", stored.content_type);
+    }
+    if (replayed) {
+        res.set_header("Idempotent-Replayed", "true");
+    }
+    return res;
 }
 
 crow::response Routes::handleLogin(const crow::request& req) {
@@ -137,16 +225,7 @@ crow::response Routes::handleGetAccounts(const crow::request& req) {
         
         std::vector<Account> accounts = db->getAccountsByUserId(user_id);
         
-        crow::json::wvalue response_json = crow::json::wvalue::list();
-        for (size_t i = 0; i < accounts.size(); ++i) {
-            response_json[i]["id"] = accounts[i].id;
-            response_json[i]["account_number"] = accounts[i].account_number;
-            response_json[i]["account_type"] = accounts[i].account_type;
-            response_json[i]["balance"] = accounts[i].balance;
-            response_json[i]["status"] = accounts[i].status;
-        }
-        
-        return crow::response(200, response_json);
+        return crow::response(200, accountsToJson(accounts));
     } catch (const std::exception& e) {
         std::cerr << "Get accounts error: " << e.what() << std::endl;
         return crow::response(500, "Internal server error");
@@ -239,10 +318,27 @@ crow::response Routes::handleTransfer(const crow::request& req) {
             return crow::response(400, "Insufficient balance");
         }
         
+        // Velocity limits, checked in memory before any money moves
+        VelocityDecision decision;
+        if (velocity) {
+            decision = velocity->admit(from_acc.id, from_acc.user_id, amount);
+            if (!decision.allowed) {
+                crow::json::wvalue response_json;
+                response_json["success"] = false;
+                response_json["message"] = "Transfer limit exceeded";
+                response_json["reason_code"] = decision.reason_code;
+                return crow::response(403, response_json);
+            }
+        }
+        
         // Perform transfer
         bool success = db->updateAccountBalance(from_acc.id, from_acc.balance - amount) &&
                       db->updateAccountBalance(to_acc.id, to_acc.balance + amount);
         
+        if (!success && velocity) {
+            velocity->release(from_acc.id, from_acc.user_id, amount, decision.admitted_at);
+        }
+        
         if (success) {
             // Create transaction record
             Transaction transaction;
@@ -255,6 +351,11 @@ crow::response Routes::handleTransfer(const crow::request& req) {
             transaction.status = "completed";
             
             db->createTransaction(transaction);
+            if (!db->applyTransactionRollups(transaction, from_acc.balance - amount, to_acc.balance + amount)) {
+                // The transfer stands; banking_rollup_rebuild repairs the rollups
+                std::cerr << "Error applying rollups for transaction " << transaction.id << " ("
+                          << transaction.from_account << " -> " << transaction.to_account << ")" << std::endl;
+            }
             
             crow::json::wvalue response_json;
             response_json["success"] = true;
@@ -314,21 +415,173 @@ crow::response Routes::handleGetTransactions(const std::string& account_id, cons
         
         std::vector<Transaction> transactions = db->getTransactionsByAccountId(account_id);
         
-        crow::json::wvalue response_json = crow::json::wvalue::list();
-        for (size_t i = 0; i < transactions.size(); ++i) {
-            response_json[i]["id"] = transactions[i].id;
-            response_json[i]["from_account"] = transactions[i].from_account;
-            response_json[i]["to_account"] = transactions[i].to_account;
-            response_json[i]["amount"] = transactions[i].amount;
-            response_json[i]["transaction_type"] = transactions[i].transaction_type;
-            response_json[i]["description"] = transactions[i].description;
-            response_json[i]["timestamp"] = transactions[i].timestamp;
-            response_json[i]["status"] = transactions[i].status;
+        return crow::response(200, transactionsToJson(transactions));
+    } catch (const std::exception& e) {
+        std::cerr << "Get transactions error: " << e.what() << std::endl;
+        return crow::response(500, "Internal server error");
+    }
+}
+
+crow::response Routes::handleGetAccountSummary(const std::string& account_id, const crow::request& req) {
+    try {
+        // Verify token
+        std::string token = req.get_header_value("Authorization");
+        if (token.empty()) {
+            return crow::response(401, "Missing authorization token");
+        }
+        
+        std::string user_id;
+        if (!Auth::verifyToken(token, user_id)) {
+            return crow::response(401, "Invalid token");
+        }
+        
+        const char* granularity_param = req.url_params.get("granularity");
+        std::string granularity = granularity_param ? granularity_param : "month";
+        if (!Rollups::isValidGranularity(granularity)) {
+            return crow::response(400, "Invalid granularity");
+        }
+        
+        // Another user's account is reported as missing so ids can't be probed
+        Account account = db->getAccountById(account_id);
+        if (account.id.empty() || account.user_id != user_id) {
+            return crow::response(404, "Account not found");
+        }
+        
+        // Served from the rollups alone; never scans the transaction history
+        std::vector<AccountRollup> rollups = db->getAccountRollups(account_id, granularity);
+        
+        crow::json::wvalue response_json;
+        response_json["account_id"] = account_id;
+        response_json["granularity"] = granularity;
+        response_json["periods"] = crow::json::wvalue::list();
+        for (size_t i = 0; i < rollups.size(); ++i) {
+            response_json["periods"][i]["period"] = rollups[i].period;
+            response_json["periods"][i]["count"] = rollups[i].count;
+            response_json["periods"][i]["debits"] = rollups[i].debits;
+            response_json["periods"][i]["credits"] = rollups[i].credits;
+            response_json["periods"][i]["net"] = rollups[i].credits - rollups[i].debits;
+            response_json["periods"][i]["closing_balance"] = rollups[i].closing_balance;
         }
         
         return crow::response(200, response_json);
     } catch (const std::exception& e) {
-        std::cerr << "Get transactions error: " << e.what() << std::endl;
+        std::cerr << "Get account summary error: " << e.what() << std::endl;
         return crow::response(500, "Internal server error");
     }
 }
+
+static const char* workerStateName(WorkerState state) {
+    switch (state) {
+        case WorkerState::Starting:
+            return "starting";
+        case WorkerState::Ready:
+            return "ready";
+        case WorkerState::Draining:
+            return "draining";
+        default:
+            return "free";
+    }
+}
+
+crow::response Routes::handleHealth(const crow::request& req) {
+    crow::json::wvalue response_json;
+    if (!stats) {
+        response_json["status"] = "ok";
+        return crow::response(200, response_json);
+    }
+    
+    StatsSnapshot snapshot = stats->snapshot();
+    std::string status = "ok";
+    if (snapshot.ready_workers == 0) {
+        status = "unavailable";
+    } else if (snapshot.ready_workers < snapshot.configured_workers) {
+        status = "degraded";
+    }
+    
+    response_json["status"] = status;
+    response_json["workers_configured"] = static_cast<long long>(snapshot.configured_workers);
+    response_json["workers_ready"] = static_cast<long long>(snapshot.ready_workers);
+    response_json["uptime_seconds"] = static_cast<long long>(snapshot.uptime);
+    response_json["requests"] = static_cast<long long>(snapshot.requests);
+    response_json["errors"] = static_cast<long long>(snapshot.errors);
+    response_json["in_flight"] = static_cast<long long>(snapshot.in_flight);
+    response_json["average_latency_ms"] = snapshot.requests ? snapshot.latency_us / 1000.0 / snapshot.requests : 0.0;
+    
+    response_json["workers"] = crow::json::wvalue::list();
+    for (size_t i = 0; i < snapshot.workers.size(); ++i) {
+        const WorkerSnapshot& worker = snapshot.workers[i];
+        response_json["workers"][i]["index"] = worker.index;
+        response_json["workers"][i]["pid"] = worker.pid;
+        response_json["workers"][i]["cpu"] = worker.cpu;
+        response_json["workers"][i]["generation"] = worker.generation;
+        response_json["workers"][i]["state"] = workerStateName(worker.state);
+        response_json["workers"][i]["uptime_seconds"] = static_cast<long long>(worker.uptime);
+        response_json["workers"][i]["requests"] = static_cast<long long>(worker.requests);
+        response_json["workers"][i]["errors"] = static_cast<long long>(worker.errors);
+        response_json["workers"][i]["in_flight"] = static_cast<long long>(worker.in_flight);
+    }
+    
+    return crow::response(status == "unavailable" ? 503 : 200, response_json);
+}
+
+crow::response Routes::handleMetrics(const crow::request& req) {
+    if (!stats) {
+        return crow::response(404);
+    }
+    
+    // Prometheus text exposition format
+    StatsSnapshot snapshot = stats->snapshot();
+    std::ostringstream out;
+    out << "# HELP banking_requests_total HTTP requests handled, including by replaced workers\n"
+        << "# TYPE banking_requests_total counter\n"
+        << "banking_requests_total " << snapshot.requests << "\n"
+        << "# HELP banking_request_errors_total HTTP responses with a 5xx status\n"
+        << "# TYPE banking_request_errors_total counter\n"
+        << "banking_request_errors_total " << snapshot.errors << "\n"
+        << "# HELP banking_request_duration_seconds_total Time spent handling requests\n"
+        << "# TYPE banking_request_duration_seconds_total counter\n"
+        << "banking_request_duration_seconds_total " << snapshot.latency_us / 1e6 << "\n"
+        << "# HELP banking_requests_in_flight Requests being handled right now\n"
+        << "# TYPE banking_requests_in_flight gauge\n"
+        << "banking_requests_in_flight " << snapshot.in_flight << "\n"
+        << "# HELP banking_workers_ready Worker processes accepting requests\n"
+        << "# TYPE banking_workers_ready gauge\n"
+        << "banking_workers_ready " << snapshot.ready_workers << "\n"
+        << "# HELP banking_worker_requests_total HTTP requests handled by the current worker process\n"
+        << "# TYPE banking_worker_requests_total counter\n";
+    for (const WorkerSnapshot& worker : snapshot.workers) {
+        out << "banking_worker_requests_total{worker=\"" << worker.index << "\",pid=\"" << worker.pid << "\"} "
+            << worker.requests << "\n";
+    }
+    
+    crow::response response(200, out.str());
+    response.set_header("Content-Type", "text/plain; version=0.0.4");
+    return response;
+}
+
+crow::json::wvalue Routes::accountsToJson(const std::vector<Account>& accounts) {
+    crow::json::wvalue response_json = crow::json::wvalue::list();
+    for (size_t i = 0; i < accounts.size(); ++i) {
+        response_json[i]["id"] = accounts[i].id;
+        response_json[i]["account_number"] = accounts[i].account_number;
+        response_json[i]["account_type"] = accounts[i].account_type;
+        response_json[i]["balance"] = accounts[i].balance;
+        response_json[i]["status"] = accounts[i].status;
+    }
+    return response_json;
+}
+
+crow::json::wvalue Routes::transactionsToJson(const std::vector<Transaction>& transactions) {
+    crow::json::wvalue response_json = crow::json::wvalue::list();
+    for (size_t i = 0; i < transactions.size(); ++i) {
+        response_json[i]["id"] = transactions[i].id;
+        response_json[i]["from_account"] = transactions[i].from_account;
+        response_json[i]["to_account"] = transactions[i].to_account;
+        response_json[i]["amount"] = transactions[i].amount;
+        response_json[i]["transaction_type"] = transactions[i].transaction_type;
+        response_json[i]["description"] = transactions[i].description;
+        response_json[i]["timestamp"] = transactions[i].timestamp;
+        response_json[i]["status"] = transactions[i].status;
+    }
+    return response_json;
+}
@@ -0,0 +1,89 @@
+#include "server_stats.h"
+#include <sys/mman.h>
+#include <ctime>
+#include <new>
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared counters must be lock-free");
+
+// Slots follow the ServerStats header in the same mapping
+static size_t headerSize() {
+    return (sizeof(ServerStats) + alignof(WorkerSlot) - 1) / alignof(WorkerSlot) * alignof(WorkerSlot);
+}
+
+ServerStats::ServerStats(size_t slots, size_t workers)
+    : slot_count(slots), configured_workers(workers), started_at(std::time(nullptr)),
+      retired_requests(0), retired_errors(0), retired_latency_us(0) {
+    for (size_t i = 0; i < slot_count; ++i) {
+        new (&slot(i)) WorkerSlot{};
+    }
+}
+
+ServerStats* ServerStats::create(size_t slots, size_t workers, bool shared) {
+    size_t size = headerSize() + slots * sizeof(WorkerSlot);
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        (shared ? MAP_SHARED : MAP_PRIVATE) | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    return new (memory) ServerStats(slots, workers);
+}
+
+WorkerSlot& ServerStats::slot(size_t i) {
+    return reinterpret_cast<WorkerSlot*>(reinterpret_cast<char*>(this) + headerSize())[i];
+}
+
+WorkerSlot* ServerStats::acquire(int index, unsigned generation) {
+    for (size_t i = 0; i < slot_count; ++i) {
+        WorkerSlot& candidate = slot(i);
+        uint32_t expected = static_cast<uint32_t>(WorkerState::Free);
+        if (candidate.state.compare_exchange_strong(expected, static_cast<uint32_t>(WorkerState::Starting))) {
+            candidate.pid = 0;
+            candidate.index = index;
+            candidate.cpu = -1;
+            candidate.generation = generation;
+            candidate.started_at = std::time(nullptr);
+            candidate.requests = 0;
+            candidate.errors = 0;
+            candidate.in_flight = 0;
+            candidate.latency_us = 0;
+            return &candidate;
+        }
+    }
+    return nullptr;
+}
+
+void ServerStats::retire(WorkerSlot& slot) {
+    retired_requests += slot.requests.load();
+    retired_errors += slot.errors.load();
+    retired_latency_us += slot.latency_us.load();
+    slot.pid = 0;
+    slot.state = static_cast<uint32_t>(WorkerState::Free);
+}
+
+StatsSnapshot ServerStats::snapshot() {
+    int64_t now = std::time(nullptr);
+    StatsSnapshot result{configured_workers, 0, now - started_at, retired_requests.load(),
+                         retired_errors.load(), 0, retired_latency_us.load(), {}};
+    
+    for (size_t i = 0; i < slot_count; ++i) {
+        WorkerSlot& current = slot(i);
+        WorkerState state = static_cast<WorkerState>(current.state.load());
+        if (state == WorkerState::Free) {
+            continue;
+        }
+        
+        WorkerSnapshot worker{current.index.load(), current.pid.load(), current.cpu.load(),
+                              current.generation.load(), state, now - current.started_at.load(),
+                              current.requests.load(), current.errors.load(), current.in_flight.load(),
+                              current.latency_us.load()};
+        if (state == WorkerState::Ready) {
+            result.ready_workers++;
+        }
+        result.requests += worker.requests;
+        result.errors += worker.errors;
+        result.in_flight += worker.in_flight;
+        result.latency_us += worker.latency_us;
+        result.workers.push_back(worker);
+    }
+    return result;
+}
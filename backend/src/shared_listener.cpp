@@ -0,0 +1,109 @@
+#include "shared_listener.h"
+#include <atomic>
+#include <dlfcn.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+static std::atomic<bool> reuse_port{false};
+
+// TCP sockets bound so far; stopAccepting() picks out the listening ones
+static std::mutex bound_mutex;
+static std::vector<int> bound_sockets;
+
+using BindFunction = int (*)(int, const struct sockaddr*, socklen_t);
+
+static BindFunction nextBind() {
+    static BindFunction next_bind = reinterpret_cast<BindFunction>(dlsym(RTLD_NEXT, "bind"));
+    return next_bind;
+}
+
+// Replaces bind(2) for the whole executable; sets SO_REUSEPORT only once
+// enableReusePort() was called. Must stay out of banking_core: the linker
+// would pick it up for any binary that references bind.
+extern "C" int bind(int fd, const struct sockaddr* address, socklen_t length) noexcept {
+    BindFunction next_bind = nextBind();
+    if (!next_bind) {
+        errno = ENOSYS;
+        return -1;
+    }
+    
+    int type = 0;
+    socklen_t type_length = sizeof(type);
+    bool tcp = address && (address->sa_family == AF_INET || address->sa_family == AF_INET6) &&
+               getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &type_length) == 0 && type == SOCK_STREAM;
+    if (tcp && reuse_port) {
+        int enable = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable));
+    }
+    
+    int result = next_bind(fd, address, length);
+    if (result == 0 && tcp) {
+        std::lock_guard<std::mutex> lock(bound_mutex);
+        bound_sockets.push_back(fd);
+    }
+    return result;
+}
+
+void SharedListener::enableReusePort() {
+    reuse_port = true;
+}
+
+// A listening socket on an ephemeral loopback port nobody connects to
+static int idleListener(int family) {
+    int fd = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    
+    sockaddr_storage address{};
+    socklen_t length;
+    if (family == AF_INET6) {
+        auto* ipv6 = reinterpret_cast<sockaddr_in6*>(&address);
+        ipv6->sin6_family = AF_INET6;
+        ipv6->sin6_addr = in6addr_loopback;
+        length = sizeof(sockaddr_in6);
+    } else {
+        auto* ipv4 = reinterpret_cast<sockaddr_in*>(&address);
+        ipv4->sin_family = AF_INET;
+        ipv4->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        length = sizeof(sockaddr_in);
+    }
+    
+    if (nextBind()(fd, reinterpret_cast<sockaddr*>(&address), length) != 0 || listen(fd, 1) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void SharedListener::stopAccepting() {
+    std::lock_guard<std::mutex> lock(bound_mutex);
+    for (int fd : bound_sockets) {
+        int listening = 0;
+        socklen_t listening_length = sizeof(listening);
+        sockaddr_storage address{};
+        socklen_t address_length = sizeof(address);
+        if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &listening_length) != 0 || !listening ||
+            getsockname(fd, reinterpret_cast<sockaddr*>(&address), &address_length) != 0) {
+            continue;
+        }
+        
+        // dup2 closes the real listener, which leaves the SO_REUSEPORT group
+        // and the event loop's watch list, and Crow's acceptor then waits on
+        // a socket that never becomes readable. Shutting the listener down
+        // instead would make every pending accept fail at once, in a loop.
+        int idle = idleListener(address.ss_family);
+        if (idle < 0 || dup2(idle, fd) < 0) {
+            std::cerr << "Could not stop accepting on socket " << fd << std::endl;
+        }
+        if (idle >= 0) {
+            close(idle);
+        }
+    }
+    bound_sockets.clear();
+}
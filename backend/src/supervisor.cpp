@@ -0,0 +1,228 @@
+#include "supervisor.h"
+#include <errno.h>
+#include <sched.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+static sigset_t supervisorSignals() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGCHLD);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    return signals;
+}
+
+static std::string describeExit(int status) {
+    if (WIFEXITED(status)) {
+        return "exit status " + std::to_string(WEXITSTATUS(status));
+    }
+    if (WIFSIGNALED(status)) {
+        return std::string("signal ") + strsignal(WTERMSIG(status));
+    }
+    return "status " + std::to_string(status);
+}
+
+Supervisor::Supervisor(const SupervisorOptions& supervisor_options, ServerStats* server_stats,
+                       std::function<int(WorkerSlot&)> worker)
+    : options(supervisor_options), stats(server_stats), worker_main(std::move(worker)), cpus(availableCpus()) {
+    sigemptyset(&previous_mask);
+}
+
+std::vector<int> Supervisor::availableCpus() {
+    std::vector<int> result;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                result.push_back(cpu);
+            }
+        }
+    }
+    return result;
+}
+
+bool Supervisor::spawn(int index, unsigned generation) {
+    WorkerSlot* slot = stats->acquire(index, generation);
+    if (!slot) {
+        std::cerr << "No free worker slot for worker " << index << std::endl;
+        return false;
+    }
+    int cpu = options.pin_cpus && !cpus.empty() ? cpus[index % cpus.size()] : -1;
+    slot->cpu = cpu;
+    
+    // Anything still buffered would otherwise be written by both processes
+    std::cout.flush();
+    std::cerr.flush();
+    
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::cerr << "Error forking worker " << index << ": " << strerror(errno) << std::endl;
+        stats->retire(*slot);
+        return false;
+    }
+    
+    if (pid == 0) {
+        sigprocmask(SIG_SETMASK, &previous_mask, nullptr);
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if (cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+                std::cerr << "Worker " << index << " could not be pinned to CPU " << cpu << std::endl;
+            }
+        }
+        slot->pid = getpid();
+        
+        int status = worker_main(*slot);
+        std::cout.flush();
+        std::cerr.flush();
+        _exit(status);
+    }
+    
+    slot->pid = pid;
+    workers.push_back(Worker{pid, index, generation, slot, std::chrono::steady_clock::now()});
+    return true;
+}
+
+void Supervisor::forget(pid_t pid) {
+    auto it = std::find_if(workers.begin(), workers.end(), [pid](const Worker& w) { return w.pid == pid; });
+    if (it != workers.end()) {
+        stats->retire(*it->slot);
+        workers.erase(it);
+    }
+}
+
+void Supervisor::reap() {
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        auto it = std::find_if(workers.begin(), workers.end(), [pid](const Worker& w) { return w.pid == pid; });
+        if (it == workers.end()) {
+            continue;
+        }
+        Worker worker = *it;
+        forget(pid);
+        if (stopping) {
+            continue;
+        }
+        
+        std::cerr << "Worker " << worker.index << " (pid " << pid << ") exited with "
+                  << describeExit(status) << ", restarting" << std::endl;
+        // Back off a little if the worker is crashing on startup
+        if (std::chrono::steady_clock::now() - worker.started < std::chrono::seconds(1)) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+        spawn(worker.index, worker.generation + 1);
+    }
+}
+
+bool Supervisor::waitUntilReady(pid_t pid) {
+    auto it = std::find_if(workers.begin(), workers.end(), [pid](const Worker& w) { return w.pid == pid; });
+    if (it == workers.end()) {
+        return false;
+    }
+    WorkerSlot* slot = it->slot;
+    auto deadline = std::chrono::steady_clock::now() + options.ready_timeout;
+    
+    while (std::chrono::steady_clock::now() < deadline) {
+        if (slot->state.load() == static_cast<uint32_t>(WorkerState::Ready)) {
+            return true;
+        }
+        int status;
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            std::cerr << "Worker (pid " << pid << ") exited during startup with " << describeExit(status) << std::endl;
+            forget(pid);
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return false;
+}
+
+void Supervisor::stopWorkers(const std::vector<pid_t>& pids) {
+    for (pid_t pid : pids) {
+        auto it = std::find_if(workers.begin(), workers.end(), [pid](const Worker& w) { return w.pid == pid; });
+        if (it != workers.end()) {
+            it->slot->state = static_cast<uint32_t>(WorkerState::Draining);
+        }
+        kill(pid, SIGTERM);
+    }
+    
+    auto deadline = std::chrono::steady_clock::now() + options.stop_timeout;
+    for (pid_t pid : pids) {
+        int status;
+        while (waitpid(pid, &status, WNOHANG) == 0) {
+            if (std::chrono::steady_clock::now() >= deadline) {
+                std::cerr << "Worker (pid " << pid << ") did not exit in time, killing it" << std::endl;
+                kill(pid, SIGKILL);
+                waitpid(pid, &status, 0);
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        forget(pid);
+    }
+}
+
+void Supervisor::rollingRestart() {
+    std::cout << "Rolling restart of " << workers.size() << " workers" << std::endl;
+    std::vector<Worker> previous = workers;
+    
+    for (const Worker& old : previous) {
+        if (!spawn(old.index, old.generation + 1)) {
+            std::cerr << "Rolling restart aborted" << std::endl;
+            return;
+        }
+        pid_t replacement = workers.back().pid;
+        if (!waitUntilReady(replacement)) {
+            std::cerr << "Replacement for worker " << old.index << " did not become ready; "
+                      << "keeping the old worker and aborting the rolling restart" << std::endl;
+            stopWorkers({replacement});
+            return;
+        }
+        stopWorkers({old.pid});
+    }
+    std::cout << "Rolling restart complete" << std::endl;
+}
+
+int Supervisor::run() {
+    sigset_t signals = supervisorSignals();
+    sigprocmask(SIG_BLOCK, &signals, &previous_mask);
+    
+    bool started = true;
+    for (size_t i = 0; i < options.workers && started; ++i) {
+        started = spawn(static_cast<int>(i), 0);
+    }
+    stopping = !started;
+    if (started) {
+        std::cout << "Supervisor " << getpid() << " started " << options.workers
+                  << " workers (SIGHUP: rolling restart, SIGTERM: stop)" << std::endl;
+    }
+    
+    while (!stopping) {
+        timespec timeout{1, 0};
+        int signal_number = sigtimedwait(&signals, nullptr, &timeout);
+        if (signal_number == SIGTERM || signal_number == SIGINT) {
+            stopping = true;
+        } else if (signal_number == SIGHUP) {
+            rollingRestart();
+        }
+        reap();
+    }
+    
+    std::vector<pid_t> remaining;
+    for (const Worker& worker : workers) {
+        remaining.push_back(worker.pid);
+    }
+    stopWorkers(remaining);
+    return started ? 0 : 1;
+}
@@ -1,5 +1,6 @@
 #include "utils.h"
 #include <chrono>
+#include <ctime>
 #include <iomanip>
 #include <sstream>
 #include <regex>
@@ -7,13 +8,30 @@
 
 std::string Utils::getCurrentTimestamp() {
     auto now = std::chrono::system_clock::now();
-    auto time_t = std::chrono::system_clock::to_time_t(now);
+    return formatTimestamp(std::chrono::system_clock::to_time_t(now));
+}
+
+std::string Utils::formatTimestamp(int64_t epoch_seconds) {
+    std::time_t time_t = static_cast<std::time_t>(epoch_seconds);
+    std::tm tm{};
+    gmtime_r(&time_t, &tm);
     
     std::stringstream ss;
-    ss << std::put_time(std::gmtime(&time_t), "%Y-%m-%dT%H:%M:%SZ");
+    ss << std::put_time(&tm, "%Y-%m-%dT%H:%M:%SZ");
     return ss.str();
 }
 
+int64_t Utils::parseTimestamp(const std::string& timestamp) {
+    // Inverse of formatTimestamp; returns 0 for anything unparseable
+    std::tm tm{};
+    std::istringstream ss(timestamp);
+    ss >> std::get_time(&tm, "%Y-%m-%dT%H:%M:%SZ");
+    if (ss.fail()) {
+        return 0;
+    }
+    return static_cast<int64_t>(timegm(&tm));
+}
+
 std::string Utils::generateRandomId(int length) {
     const char charset[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
     std::string result;
@@ -0,0 +1,498 @@
+#include "velocity.h"
+#include "utils.h"
+#include <crow/json.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+static int64_t nowSeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Idle keys are dropped once nothing is left in their longest window
+static const int64_t kIdleExpirySeconds = 24 * 3600;
+
+// Slots checked for idle keys each time a key is added to a shard; a full
+// shard checks more so it can make room for the key
+static const size_t kCleanupSlots = 2;
+static const size_t kFullCleanupSlots = 64;
+
+static const size_t kShardCount = 64;
+static const size_t kKeyBytes = 48;
+
+static_assert(std::atomic<int32_t>::is_always_lock_free, "shared rebuild owner must be lock-free");
+
+void VelocityEngine::Counters::add(int64_t at, double amount) {
+    minute.add(at, 1, amount);
+    hour.add(at, 1, amount);
+    day.add(at, 1, amount);
+    if (at > last_seen) {
+        last_seen = at;
+    }
+}
+
+void VelocityEngine::Counters::remove(int64_t at, double amount) {
+    minute.remove(at, amount);
+    hour.remove(at, amount);
+    day.remove(at, amount);
+}
+
+void VelocityEngine::Counters::total(VelocityWindow window, int64_t now, long long& count, double& amount) const {
+    switch (window) {
+        case VelocityWindow::Minute: minute.total(now, count, amount); break;
+        case VelocityWindow::Hour: hour.total(now, count, amount); break;
+        case VelocityWindow::Day: day.total(now, count, amount); break;
+    }
+}
+
+VelocityEngine::VelocityEngine(std::vector<VelocityRule> rules, VelocityTable* shared_table)
+    : rules(std::move(rules)), table(shared_table), owns_table(shared_table == nullptr) {
+    if (!table) {
+        table = createTable(kDefaultTableKeys, false);
+    }
+}
+
+std::vector<VelocityRule> VelocityEngine::defaultRules() {
+    return {
+        {"ACCOUNT_BURST", VelocityScope::Account, VelocityWindow::Minute, 10, 0},
+        {"ACCOUNT_HOURLY_COUNT", VelocityScope::Account, VelocityWindow::Hour, 100, 0},
+        {"ACCOUNT_DAILY_AMOUNT", VelocityScope::Account, VelocityWindow::Day, 0, 50000},
+        {"USER_BURST", VelocityScope::User, VelocityWindow::Minute, 20, 0},
+        {"USER_DAILY_AMOUNT", VelocityScope::User, VelocityWindow::Day, 0, 100000},
+    };
+}
+
+bool VelocityEngine::loadRules(const std::string& path, std::vector<VelocityRule>& rules) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Cannot open velocity rules file: " << path << std::endl;
+        return false;
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    
+    auto json_data = crow::json::load(contents.str());
+    if (!json_data || !json_data.has("rules")) {
+        std::cerr << "Invalid velocity rules file: " << path << std::endl;
+        return false;
+    }
+    
+    std::vector<VelocityRule> loaded;
+    try {
+        for (const auto& item : json_data["rules"]) {
+            VelocityRule rule;
+            rule.reason_code = item["reason_code"].s();
+            
+            std::string scope = item["scope"].s();
+            if (scope == "account") {
+                rule.scope = VelocityScope::Account;
+            } else if (scope == "user") {
+                rule.scope = VelocityScope::User;
+            } else {
+                std::cerr << "Unknown velocity rule scope: " << scope << std::endl;
+                return false;
+            }
+            
+            std::string window = item["window"].s();
+            if (window == "1m") {
+                rule.window = VelocityWindow::Minute;
+            } else if (window == "1h") {
+                rule.window = VelocityWindow::Hour;
+            } else if (window == "24h") {
+                rule.window = VelocityWindow::Day;
+            } else {
+                std::cerr << "Unknown velocity rule window: " << window << std::endl;
+                return false;
+            }
+            
+            rule.max_count = item.has("max_count") ? item["max_count"].i() : 0;
+            rule.max_amount = item.has("max_amount") ? item["max_amount"].d() : 0.0;
+            loaded.push_back(rule);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Invalid velocity rule in " << path << ": " << e.what() << std::endl;
+        return false;
+    }
+    
+    rules = loaded;
+    return true;
+}
+
+enum class KeyKind : uint8_t { Empty = 0, Account, User };
+
+// Keys are stored inline so the table holds no pointers. Longer keys than
+// fit keep a prefix plus a hash of the whole key; those encode to exactly
+// kKeyBytes - 1 characters, which no stored short key does.
+struct TableKey {
+    KeyKind kind;
+    char bytes[kKeyBytes];
+    uint64_t hash;
+    
+    TableKey(KeyKind key_kind, const std::string& key) : kind(key_kind), bytes{} {
+        if (key.size() < kKeyBytes - 1) {
+            std::memcpy(bytes, key.data(), key.size());
+        } else {
+            std::memcpy(bytes, key.data(), kKeyBytes - 17);
+            std::snprintf(bytes + kKeyBytes - 17, 17, "%016llx", static_cast<unsigned long long>(fnv1a(key.data(), key.size())));
+        }
+        hash = fnv1a(bytes, std::strlen(bytes));
+    }
+    
+    // Stable across processes, unlike std::hash
+    static uint64_t fnv1a(const char* data, size_t size) {
+        uint64_t value = 14695981039346656037ULL;
+        for (size_t i = 0; i < size; ++i) {
+            value ^= static_cast<unsigned char>(data[i]);
+            value *= 1099511628211ULL;
+        }
+        return value;
+    }
+};
+
+// Header of the mapping; each shard's slots follow it, open-addressed with
+// linear probing. Idle keys are deleted a few slots at a time by a cursor
+// that each new key advances, using backward-shift deletion so probe chains
+// stay unbroken without tombstones. Nothing is allocated under a shard lock.
+struct VelocityTable {
+    struct Slot {
+        KeyKind kind;
+        char key[kKeyBytes];
+        uint64_t hash;
+        VelocityEngine::Counters counters;
+    };
+    
+    struct alignas(64) Shard {
+        pthread_mutex_t mutex;
+        size_t used;
+        size_t cleanup_cursor;
+    };
+    
+    // 0 until the history has been replayed, then -1; in between, the pid
+    // of the process replaying it
+    static constexpr int32_t kBuilt = -1;
+    
+    size_t mapping_size;
+    size_t slots_per_shard;
+    std::atomic<int32_t> rebuild_owner;
+    Shard shards[kShardCount];
+    
+    VelocityTable(size_t size, size_t per_shard, bool shared)
+        : mapping_size(size), slots_per_shard(per_shard), rebuild_owner(0) {
+        // Robust, so a worker that dies holding a shard lock cannot wedge the others
+        pthread_mutexattr_t attributes;
+        pthread_mutexattr_init(&attributes);
+        pthread_mutexattr_setpshared(&attributes, shared ? PTHREAD_PROCESS_SHARED : PTHREAD_PROCESS_PRIVATE);
+        pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+        for (Shard& shard : shards) {
+            pthread_mutex_init(&shard.mutex, &attributes);
+            shard.used = 0;
+            shard.cleanup_cursor = 0;
+        }
+        pthread_mutexattr_destroy(&attributes);
+    }
+    
+    ~VelocityTable() {
+        for (Shard& shard : shards) {
+            pthread_mutex_destroy(&shard.mutex);
+        }
+    }
+    
+    // Past 7/8 full, probes get long; the shard counts as full
+    size_t shardLimit() const { return slots_per_shard - slots_per_shard / 8; }
+    
+    Shard& shardFor(const TableKey& key) { return shards[key.hash % kShardCount]; }
+    
+    size_t home(uint64_t hash) const { return (hash / kShardCount) % slots_per_shard; }
+    
+    Slot* slotsOf(Shard& shard) {
+        size_t index = static_cast<size_t>(&shard - shards);
+        return reinterpret_cast<Slot*>(this + 1) + index * slots_per_shard;
+    }
+    
+    Slot* find(Shard& shard, const TableKey& key) {
+        Slot* slots = slotsOf(shard);
+        size_t position = home(key.hash);
+        for (size_t probe = 0; probe < slots_per_shard; ++probe) {
+            Slot& slot = slots[(position + probe) % slots_per_shard];
+            if (slot.kind == KeyKind::Empty) {
+                return nullptr;
+            }
+            if (slot.hash == key.hash && slot.kind == key.kind && std::strncmp(slot.key, key.bytes, kKeyBytes) == 0) {
+                return &slot;
+            }
+        }
+        return nullptr;
+    }
+    
+    bool hasRoom(const Shard& shard, size_t keys) const { return shard.used + keys <= shardLimit(); }
+    
+    // Finds the key's slot or claims an empty one; null when the shard is full
+    Slot* insert(Shard& shard, const TableKey& key) {
+        Slot* existing = find(shard, key);
+        if (existing || !hasRoom(shard, 1)) {
+            return existing;
+        }
+        
+        Slot* slots = slotsOf(shard);
+        size_t position = home(key.hash);
+        while (slots[position].kind != KeyKind::Empty) {
+            position = (position + 1) % slots_per_shard;
+        }
+        Slot& slot = slots[position];
+        slot.kind = key.kind;
+        std::memcpy(slot.key, key.bytes, kKeyBytes);
+        slot.hash = key.hash;
+        slot.counters = VelocityEngine::Counters{};
+        shard.used++;
+        return &slot;
+    }
+    
+    // Empties slot i, then walks the rest of its cluster moving back any
+    // key whose home is not between the gap and its current position
+    void remove(Shard& shard, size_t i) {
+        Slot* slots = slotsOf(shard);
+        size_t gap = i;
+        size_t next = i;
+        while (true) {
+            next = (next + 1) % slots_per_shard;
+            if (slots[next].kind == KeyKind::Empty) {
+                break;
+            }
+            size_t wanted = home(slots[next].hash);
+            bool stays = gap <= next ? (gap < wanted && wanted <= next) : (gap < wanted || wanted <= next);
+            if (!stays) {
+                slots[gap] = slots[next];
+                gap = next;
+            }
+        }
+        slots[gap].kind = KeyKind::Empty;
+        shard.used--;
+    }
+    
+    // Moves slots, so it runs before any slot of the shard is looked up
+    void cleanup(Shard& shard, int64_t now) {
+        size_t budget = hasRoom(shard, 2) ? kCleanupSlots : kFullCleanupSlots;
+        Slot* slots = slotsOf(shard);
+        for (size_t checked = 0; checked < budget && shard.used > 0; ++checked) {
+            Slot& slot = slots[shard.cleanup_cursor];
+            if (slot.kind != KeyKind::Empty && now - slot.counters.last_seen > kIdleExpirySeconds) {
+                // Stay put: a key from further on may have moved into this slot
+                remove(shard, shard.cleanup_cursor);
+            } else {
+                shard.cleanup_cursor = (shard.cleanup_cursor + 1) % slots_per_shard;
+            }
+        }
+    }
+    
+    void clear() {
+        for (Shard& shard : shards) {
+            ShardLock lock(shard);
+            std::memset(static_cast<void*>(slotsOf(shard)), 0, slots_per_shard * sizeof(Slot));
+            shard.used = 0;
+        }
+    }
+    
+    class ShardLock {
+    private:
+        pthread_mutex_t* mutex;
+        
+    public:
+        explicit ShardLock(Shard& shard) : mutex(&shard.mutex) {
+            // The previous holder died mid-update; at worst one transfer
+            // is miscounted or one key's counters are lost
+            if (pthread_mutex_lock(mutex) == EOWNERDEAD) {
+                pthread_mutex_consistent(mutex);
+            }
+        }
+        ~ShardLock() { pthread_mutex_unlock(mutex); }
+        
+        ShardLock(const ShardLock&) = delete;
+        ShardLock& operator=(const ShardLock&) = delete;
+    };
+};
+
+using ShardLock = VelocityTable::ShardLock;
+
+VelocityTable* VelocityEngine::createTable(size_t keys, bool shared) {
+    size_t per_shard = std::max<size_t>(16, (keys + kShardCount - 1) / kShardCount);
+    size_t size = sizeof(VelocityTable) + kShardCount * per_shard * sizeof(VelocityTable::Slot);
+    
+    // Anonymous mappings start zeroed, so every slot starts empty
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        (shared ? MAP_SHARED : MAP_PRIVATE) | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (memory == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    return new (memory) VelocityTable(size, per_shard, shared);
+}
+
+VelocityEngine::~VelocityEngine() {
+    if (owns_table) {
+        size_t size = table->mapping_size;
+        table->~VelocityTable();
+        munmap(table, size);
+    }
+}
+
+VelocityDecision VelocityEngine::admit(const std::string& account_id, const std::string& user_id, double amount) {
+    VelocityDecision decision;
+    decision.admitted_at = nowSeconds();
+    int64_t now = decision.admitted_at;
+    
+    TableKey account_key(KeyKind::Account, account_id);
+    TableKey user_key(KeyKind::User, user_id);
+    VelocityTable::Shard& account_shard = table->shardFor(account_key);
+    VelocityTable::Shard& user_shard = table->shardFor(user_key);
+    
+    // Lock both shards in address order so concurrent admits can't deadlock
+    ShardLock first_lock(&account_shard < &user_shard ? account_shard : user_shard);
+    std::unique_ptr<ShardLock> second_lock;
+    if (&account_shard != &user_shard) {
+        second_lock.reset(new ShardLock(&account_shard < &user_shard ? user_shard : account_shard));
+    }
+    
+    VelocityTable::Slot* account_slot = table->find(account_shard, account_key);
+    VelocityTable::Slot* user_slot = table->find(user_shard, user_key);
+    
+    for (const auto& rule : rules) {
+        long long count = 0;
+        double sum = 0.0;
+        if (rule.scope == VelocityScope::Account && account_slot) {
+            account_slot->counters.total(rule.window, now, count, sum);
+        } else if (rule.scope == VelocityScope::User && user_slot) {
+            user_slot->counters.total(rule.window, now, count, sum);
+        }
+        
+        if ((rule.max_count > 0 && count + 1 > rule.max_count) ||
+            (rule.max_amount > 0 && sum + amount > rule.max_amount)) {
+            decision.allowed = false;
+            decision.reason_code = rule.reason_code;
+            return decision;
+        }
+    }
+    
+    // Adding a key is when room is needed, so that is when idle keys are
+    // cleaned up. Cleanup moves slots, so both are looked up again after it.
+    if (!account_slot || !user_slot) {
+        table->cleanup(account_shard, now);
+        if (&user_shard != &account_shard) {
+            table->cleanup(user_shard, now);
+        }
+        account_slot = table->find(account_shard, account_key);
+        user_slot = table->find(user_shard, user_key);
+    }
+    
+    // No room to track the transfer means no way to limit it; fail closed.
+    // Room for both keys is checked first so a rejection inserts neither.
+    size_t account_needs = account_slot ? 0 : 1;
+    size_t user_needs = user_slot ? 0 : 1;
+    bool room = &account_shard == &user_shard
+        ? table->hasRoom(account_shard, account_needs + user_needs)
+        : table->hasRoom(account_shard, account_needs) && table->hasRoom(user_shard, user_needs);
+    if (!room) {
+        decision.allowed = false;
+        decision.reason_code = "VELOCITY_CAPACITY";
+        return decision;
+    }
+    
+    // Inserting never moves existing slots, so account_slot and user_slot stay valid
+    if (!account_slot) {
+        account_slot = table->insert(account_shard, account_key);
+    }
+    if (!user_slot) {
+        user_slot = table->insert(user_shard, user_key);
+    }
+    
+    account_slot->counters.add(now, amount);
+    user_slot->counters.add(now, amount);
+    return decision;
+}
+
+void VelocityEngine::release(const std::string& account_id, const std::string& user_id, double amount, int64_t admitted_at) {
+    for (const TableKey& key : {TableKey(KeyKind::Account, account_id), TableKey(KeyKind::User, user_id)}) {
+        VelocityTable::Shard& shard = table->shardFor(key);
+        ShardLock lock(shard);
+        VelocityTable::Slot* slot = table->find(shard, key);
+        if (slot) {
+            slot->counters.remove(admitted_at, amount);
+        }
+    }
+}
+
+void VelocityEngine::record(const std::string& account_id, const std::string& user_id, double amount, int64_t at) {
+    for (const TableKey& key : {TableKey(KeyKind::Account, account_id), TableKey(KeyKind::User, user_id)}) {
+        VelocityTable::Shard& shard = table->shardFor(key);
+        ShardLock lock(shard);
+        VelocityTable::Slot* slot = table->find(shard, key);
+        if (!slot) {
+            table->cleanup(shard, nowSeconds());
+            slot = table->insert(shard, key);
+        }
+        if (slot) {
+            slot->counters.add(at, amount);
+        }
+    }
+}
+
+size_t VelocityEngine::rebuild(Database* db) {
+    // Workers sharing a table replay the history once between them. If the
+    // worker replaying it dies part-way, nobody has admitted against the
+    // table yet (they are all still waiting here), so the next one clears
+    // it and starts over.
+    int32_t self = static_cast<int32_t>(getpid());
+    while (true) {
+        int32_t owner = 0;
+        if (table->rebuild_owner.compare_exchange_strong(owner, self)) {
+            break;
+        }
+        if (owner == VelocityTable::kBuilt) {
+            return 0;
+        }
+        if (kill(owner, 0) != 0 && errno == ESRCH && table->rebuild_owner.compare_exchange_strong(owner, self)) {
+            table->clear();
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    
+    int64_t since = nowSeconds() - kIdleExpirySeconds;
+    std::vector<Transaction> transactions = db->getTransactionsSince(Utils::formatTimestamp(since));
+    
+    // Limits apply to the owner of the debited account
+    std::unordered_map<std::string, std::string> owners;
+    size_t counted = 0;
+    for (const auto& transaction : transactions) {
+        if (transaction.transaction_type != "transfer" || transaction.status != "completed") {
+            continue;
+        }
+        
+        auto owner = owners.find(transaction.from_account);
+        if (owner == owners.end()) {
+            owner = owners.emplace(transaction.from_account, db->getAccountById(transaction.from_account).user_id).first;
+        }
+        if (owner->second.empty()) {
+            continue;
+        }
+        
+        record(transaction.from_account, owner->second, transaction.amount, Utils::parseTimestamp(transaction.timestamp));
+        counted++;
+    }
+    
+    table->rebuild_owner = VelocityTable::kBuilt;
+    return counted;
+}
@@ -0,0 +1,162 @@
+#include "idempotency.h"
+#include "memory_database.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+// Behavior checks for Idempotency-Key handling: what is kept, what counts
+// as a replay, and what happens when the database misbehaves.
+
+static int failures = 0;
+
+#define CHECK(condition)                                                          \
+    do {                                                                          \
+        if (!(condition)) {                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: "        \
+                      << #condition << std::endl;                                 \
+            failures++;                                                           \
+        }                                                                         \
+    } while (0)
+
+// In-memory database whose idempotency calls can be made to fail
+class FlakyDatabase : public MemoryDatabase {
+public:
+    bool claims_unavailable = false;
+    bool saves_fail = false;
+    std::atomic<int> releases{0};
+    
+    ClaimResult claimIdempotencyKey(const std::string& key, const std::string& fingerprint) override {
+        if (claims_unavailable) {
+            return ClaimResult::Unavailable;
+        }
+        return MemoryDatabase::claimIdempotencyKey(key, fingerprint);
+    }
+    
+    bool saveIdempotencyRecord(const IdempotencyRecord& record) override {
+        return !saves_fail && MemoryDatabase::saveIdempotencyRecord(record);
+    }
+    
+    bool releaseIdempotencyKey(const std::string& key) override {
+        releases++;
+        return MemoryDatabase::releaseIdempotencyKey(key);
+    }
+};
+
+static std::function<StoredResponse()> respond(int status, std::atomic<int>& runs, bool transient = false,
+                                               std::chrono::milliseconds delay = std::chrono::milliseconds(0)) {
+    return [status, &runs, transient, delay]() {
+        runs++;
+        std::this_thread::sleep_for(delay);
+        StoredResponse response{status, "body", ""};
+        response.transient = transient;
+        return response;
+    };
+}
+
+static void completedResponsesAreReplayed() {
+    FlakyDatabase db;
+    IdempotencyStore store(&db);
+    std::atomic<int> runs{0};
+    bool replayed = false;
+    
+    CHECK(store.execute("key", "f", respond(200, runs), replayed).status == 200);
+    CHECK(!replayed);
+    CHECK(store.execute("key", "f", respond(200, runs), replayed).status == 200);
+    CHECK(replayed);
+    CHECK(runs == 1);
+    
+    // Another process sees the stored record
+    IdempotencyStore other(&db);
+    CHECK(other.execute("key", "f", respond(200, runs), replayed).status == 200);
+    CHECK(replayed);
+    CHECK(runs == 1);
+}
+
+static void transientRejectionsAreNotKept() {
+    FlakyDatabase db;
+    IdempotencyStore store(&db);
+    std::atomic<int> runs{0};
+    bool replayed = false;
+    
+    CHECK(store.execute("key", "f", respond(403, runs, true), replayed).status == 403);
+    CHECK(store.execute("key", "f", respond(200, runs), replayed).status == 200);
+    CHECK(!replayed);
+    CHECK(runs == 2);
+    CHECK(db.releases == 1);
+}
+
+static void passedOnFailuresAreNotReplays() {
+    FlakyDatabase db;
+    IdempotencyStore store(&db);
+    std::atomic<int> runs{0};
+    
+    // A duplicate waiting on a request that fails gets its 500, unmarked
+    std::thread first([&] {
+        bool replayed = false;
+        store.execute("key", "f", respond(500, runs, false, std::chrono::milliseconds(200)), replayed);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    bool replayed = true;
+    CHECK(store.execute("key", "f", respond(200, runs), replayed).status == 500);
+    CHECK(!replayed);
+    first.join();
+    CHECK(runs == 1);
+}
+
+static void unreachableDatabaseDoesNotRunHandler() {
+    FlakyDatabase db;
+    db.claims_unavailable = true;
+    IdempotencyStore store(&db);
+    std::atomic<int> runs{0};
+    bool replayed = true;
+    
+    CHECK(store.execute("key", "f", respond(200, runs), replayed).status == 503);
+    CHECK(!replayed);
+    CHECK(runs == 0);
+    
+    // Nothing was kept, so the retry runs once the database is back
+    db.claims_unavailable = false;
+    CHECK(store.execute("key", "f", respond(200, runs), replayed).status == 200);
+    CHECK(runs == 1);
+}
+
+static void unsavedResponsesKeepTheirClaim() {
+    FlakyDatabase db;
+    db.saves_fail = true;
+    IdempotencyStore store(&db);
+    std::atomic<int> runs{0};
+    bool replayed = false;
+    
+    CHECK(store.execute("key", "f", respond(200, runs), replayed).status == 200);
+    CHECK(db.releases == 0);
+    
+    IdempotencyRecord record;
+    CHECK(db.findIdempotencyRecord("key", record) && record.status_code == 0);
+    
+    // Another process must not run it again while the claim is held
+    IdempotencyStore other(&db);
+    CHECK(other.execute("key", "f", respond(200, runs), replayed).status == 409);
+    CHECK(runs == 1);
+    
+    // This process still replays what it ran
+    CHECK(store.execute("key", "f", respond(200, runs), replayed).status == 200);
+    CHECK(replayed);
+    CHECK(runs == 1);
+}
+
+int main() {
+    completedResponsesAreReplayed();
+    transientRejectionsAreNotKept();
+    passedOnFailuresAreNotReplays();
+    unreachableDatabaseDoesNotRunHandler();
+    unsavedResponsesKeepTheirClaim();
+    
+    if (failures > 0) {
+        std::cerr << failures << " idempotency check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "idempotency checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,197 @@
+#include "velocity.h"
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Behavior checks for the transfer velocity limits. Each check builds its
+// own engine with a single rule so a failure points at one behavior.
+
+static int failures = 0;
+
+#define CHECK(condition)                                                          \
+    do {                                                                          \
+        if (!(condition)) {                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: "        \
+                      << #condition << std::endl;                                 \
+            failures++;                                                           \
+        }                                                                         \
+    } while (0)
+
+static int64_t nowSeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static VelocityEngine engineWith(VelocityScope scope, VelocityWindow window, long long max_count, double max_amount) {
+    return VelocityEngine(std::vector<VelocityRule>{{"LIMIT", scope, window, max_count, max_amount}});
+}
+
+static void countLimitBoundary() {
+    VelocityEngine engine = engineWith(VelocityScope::Account, VelocityWindow::Minute, 3, 0);
+    CHECK(engine.admit("acc", "user", 1).allowed);
+    CHECK(engine.admit("acc", "user", 1).allowed);
+    CHECK(engine.admit("acc", "user", 1).allowed);
+    
+    VelocityDecision decision = engine.admit("acc", "user", 1);
+    CHECK(!decision.allowed);
+    CHECK(decision.reason_code == "LIMIT");
+    
+    // Other accounts have their own counters
+    CHECK(engine.admit("other", "user", 1).allowed);
+}
+
+static void amountLimitBoundary() {
+    VelocityEngine engine = engineWith(VelocityScope::Account, VelocityWindow::Day, 0, 100);
+    CHECK(engine.admit("acc", "user", 60).allowed);
+    CHECK(engine.admit("acc", "user", 40).allowed);    // exactly at the limit
+    CHECK(!engine.admit("acc", "user", 0.01).allowed);
+}
+
+static void rejectedTransfersAreNotCounted() {
+    VelocityEngine engine = engineWith(VelocityScope::Account, VelocityWindow::Day, 0, 100);
+    CHECK(engine.admit("acc", "user", 90).allowed);
+    CHECK(!engine.admit("acc", "user", 50).allowed);
+    CHECK(!engine.admit("acc", "user", 50).allowed);
+    CHECK(engine.admit("acc", "user", 10).allowed);
+}
+
+static void releaseGivesBackCountAndAmount() {
+    VelocityEngine count_engine = engineWith(VelocityScope::Account, VelocityWindow::Minute, 2, 0);
+    CHECK(count_engine.admit("acc", "user", 1).allowed);
+    VelocityDecision second = count_engine.admit("acc", "user", 1);
+    CHECK(second.allowed);
+    CHECK(!count_engine.admit("acc", "user", 1).allowed);
+    
+    count_engine.release("acc", "user", 1, second.admitted_at);
+    CHECK(count_engine.admit("acc", "user", 1).allowed);
+    CHECK(!count_engine.admit("acc", "user", 1).allowed);
+    
+    VelocityEngine amount_engine = engineWith(VelocityScope::User, VelocityWindow::Day, 0, 100);
+    VelocityDecision large = amount_engine.admit("acc", "user", 80);
+    CHECK(large.allowed);
+    CHECK(!amount_engine.admit("acc", "user", 30).allowed);
+    
+    amount_engine.release("acc", "user", 80, large.admitted_at);
+    CHECK(amount_engine.admit("acc", "user", 100).allowed);
+    
+    // Releasing something that was never admitted changes nothing
+    VelocityEngine untouched = engineWith(VelocityScope::Account, VelocityWindow::Minute, 1, 0);
+    untouched.release("acc", "user", 1, nowSeconds());
+    CHECK(untouched.admit("acc", "user", 1).allowed);
+    CHECK(!untouched.admit("acc", "user", 1).allowed);
+}
+
+static void windowsExpire() {
+    int64_t now = nowSeconds();
+    
+    VelocityEngine minute = engineWith(VelocityScope::Account, VelocityWindow::Minute, 2, 0);
+    minute.record("old", "user", 1, now - 120);
+    minute.record("old", "user", 1, now - 120);
+    CHECK(minute.admit("old", "user", 1).allowed);
+    
+    minute.record("recent", "user", 1, now - 20);
+    minute.record("recent", "user", 1, now - 20);
+    CHECK(!minute.admit("recent", "user", 1).allowed);
+    
+    VelocityEngine hour = engineWith(VelocityScope::Account, VelocityWindow::Hour, 1, 0);
+    hour.record("old", "user", 1, now - 3700);
+    CHECK(hour.admit("old", "user", 1).allowed);
+    hour.record("recent", "user", 1, now - 1800);
+    CHECK(!hour.admit("recent", "user", 1).allowed);
+    
+    VelocityEngine day = engineWith(VelocityScope::Account, VelocityWindow::Day, 0, 100);
+    day.record("old", "user", 100, now - 25 * 3600);
+    CHECK(day.admit("old", "user", 100).allowed);
+    day.record("recent", "user", 100, now - 23 * 3600);
+    CHECK(!day.admit("recent", "user", 1).allowed);
+}
+
+static void userLimitsSpanAccounts() {
+    VelocityEngine engine = engineWith(VelocityScope::User, VelocityWindow::Minute, 2, 0);
+    CHECK(engine.admit("acc-1", "user", 1).allowed);
+    CHECK(engine.admit("acc-2", "user", 1).allowed);
+    CHECK(!engine.admit("acc-3", "user", 1).allowed);
+    CHECK(engine.admit("acc-3", "other-user", 1).allowed);
+}
+
+static void limitsAreSharedAcrossProcesses() {
+    VelocityTable* table = VelocityEngine::createTable(1024, true);
+    std::vector<VelocityRule> rules{{"LIMIT", VelocityScope::Account, VelocityWindow::Minute, 3, 0}};
+    
+    pid_t child = fork();
+    if (child == 0) {
+        VelocityEngine worker(rules, table);
+        bool admitted = worker.admit("acc", "user", 1).allowed && worker.admit("acc", "user", 1).allowed;
+        _exit(admitted ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    
+    // The child's two transfers count here too
+    VelocityEngine engine(rules, table);
+    CHECK(engine.admit("acc", "user", 1).allowed);
+    CHECK(!engine.admit("acc", "user", 1).allowed);
+}
+
+static void fullTableFailsClosed() {
+    // The smallest table: 16 slots per shard, full at 14
+    VelocityEngine engine(std::vector<VelocityRule>{{"LIMIT", VelocityScope::Account, VelocityWindow::Minute, 1, 0}},
+                          VelocityEngine::createTable(0, false));
+    int64_t now = nowSeconds();
+    std::string long_key(60, 'a');
+    CHECK(engine.admit(long_key, "user", 1).allowed);
+    for (int i = 0; i < 2000; ++i) {
+        engine.record("live-" + std::to_string(i), "user", 1, now);
+    }
+    
+    VelocityDecision decision = engine.admit("new", "user", 1);
+    CHECK(!decision.allowed);
+    CHECK(decision.reason_code == "VELOCITY_CAPACITY");
+    CHECK(engine.admit(long_key, "user", 1).reason_code == "LIMIT");
+}
+
+static void idleKeysMakeRoomWithoutLosingOthers() {
+    VelocityEngine engine(std::vector<VelocityRule>{{"LIMIT", VelocityScope::Account, VelocityWindow::Minute, 1, 0}},
+                          VelocityEngine::createTable(0, false));
+    int64_t now = nowSeconds();
+    std::string long_key(60, 'b');
+    CHECK(engine.admit(long_key, "user", 1).allowed);
+    
+    // Far more keys than the table holds, most of them already idle; each
+    // record cleans up a little, deleting idle keys from the middle of
+    // probe chains that live keys sit in
+    for (int i = 0; i < 4000; ++i) {
+        bool live = i % 10 == 0;
+        engine.record((live ? "live-" : "idle-") + std::to_string(i), live ? "user" : "idle-user", 1,
+                      live ? now : now - 25 * 3600);
+    }
+    
+    for (int i = 0; i < 4000; i += 10) {
+        CHECK(engine.admit("live-" + std::to_string(i), "user", 1).reason_code == "LIMIT");
+    }
+    CHECK(engine.admit(long_key, "user", 1).reason_code == "LIMIT");
+    CHECK(engine.admit("new", "user", 1).allowed);
+}
+
+int main() {
+    countLimitBoundary();
+    amountLimitBoundary();
+    rejectedTransfersAreNotCounted();
+    releaseGivesBackCountAndAmount();
+    windowsExpire();
+    userLimitsSpanAccounts();
+    limitsAreSharedAcrossProcesses();
+    fullTableFailsClosed();
+    idleKeysMakeRoomWithoutLosingOthers();
+    
+    if (failures > 0) {
+        std::cerr << failures << " velocity check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "velocity checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <mongocxx/instance.hpp>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "batch_jobs.h"
+
+// Bulk jobs over the accounts collection, meant to run from cron.
+//
+// Usage: banking_batch accrue [--run-date YYYY-MM-DD] [--batch-size N] [--threads N]
+//                             [--with-fees] [--restart] [--rate TYPE=ANNUAL]
+//                             [--fee TYPE=AMOUNT:WAIVER_BALANCE] [--mongo-uri URI]
+//
+// A run is identified by its date; running accrue twice for the same date
+// resumes (or does nothing if that run already completed). --restart drops
+// the checkpoint and rescans every account, but accounts the run already
+// credited are still skipped, so it never accrues the same date twice.
+
+static int usage() {
+    std::cerr << "Usage: banking_batch accrue [--run-date YYYY-MM-DD] [--batch-size N] [--threads N]\n"
+              << "                            [--with-fees] [--restart] [--rate TYPE=ANNUAL]\n"
+              << "                            [--fee TYPE=AMOUNT:WAIVER_BALANCE] [--mongo-uri URI]" << std::endl;
+    return 2;
+}
+
+static bool splitPair(const std::string& arg, char separator, std::string& left, std::string& right) {
+    size_t pos = arg.find(separator);
+    if (pos == std::string::npos || pos == 0) {
+        return false;
+    }
+    left = arg.substr(0, pos);
+    right = arg.substr(pos + 1);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2 || std::string(argv[1]) != "accrue") {
+        return usage();
+    }
+    
+    AccrualOptions options;
+    options.rates = BatchJobs::defaultRates();
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string type, value;
+        if (arg == "--run-date" && i + 1 < argc) {
+            options.run_date = argv[++i];
+        } else if (arg == "--batch-size" && i + 1 < argc) {
+            options.batch_size = static_cast<size_t>(std::atol(argv[++i]));
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.threads = static_cast<size_t>(std::atol(argv[++i]));
+        } else if (arg == "--with-fees") {
+            options.charge_fees = true;
+        } else if (arg == "--restart") {
+            options.restart = true;
+        } else if (arg == "--rate" && i + 1 < argc && splitPair(argv[++i], '=', type, value)) {
+            AccrualRate& rate = options.rates[type];
+            rate.annual_rate = std::atof(value.c_str());
+        } else if (arg == "--fee" && i + 1 < argc && splitPair(argv[++i], '=', type, value)) {
+            std::string amount, waiver;
+            if (!splitPair(value, ':', amount, waiver)) {
+                amount = value;
+                waiver = "0";
+            }
+            AccrualRate& rate = options.rates[type];
+            rate.monthly_fee = std::atof(amount.c_str());
+            rate.fee_waiver_balance = std::atof(waiver.c_str());
+        } else if (arg == "--mongo-uri" && i + 1 < argc) {
+            options.mongo_uri = argv[++i];
+        } else {
+            return usage();
+        }
+    }
+    if (options.batch_size == 0) {
+        options.batch_size = 1;
+    }
+    
+    mongocxx::instance inst{};
+    AccrualSummary summary;
+    if (!BatchJobs::runAccrual(options, summary)) {
+        return 1;
+    }
+    
+    if (summary.already_completed) {
+        std::cout << "Accrual for this run date already completed. --restart rescans all accounts but only "
+                  << "credits accounts this run has not (such as ones opened since) and, with --with-fees, "
+                  << "charges fees not yet charged this month" << std::endl;
+        return 0;
+    }
+    
+    std::cout << "Accrued " << summary.accounts << " accounts in " << summary.seconds << " s ("
+              << static_cast<long long>(summary.accounts / (summary.seconds > 0 ? summary.seconds : 1))
+              << " accounts/s)";
+    if (summary.resumed) {
+        std::cout << ", resumed from checkpoint";
+    }
+    std::cout << std::endl;
+    std::cout << "Updated " << summary.updated << " accounts, interest " << summary.interest_total
+              << ", fees " << summary.fees_total << std::endl;
+    
+    return 0;
+}
@@ -0,0 +1,83 @@
+#ifndef LOADGEN_HISTOGRAM_H
+#define LOADGEN_HISTOGRAM_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Log-linear latency histogram in the style of HdrHistogram: every power of
+// two is split into 128 linear sub-buckets, so recorded values keep better
+// than 1% relative precision from nanoseconds up to minutes. Recording is a
+// few integer ops and histograms from different threads merge by addition.
+class LatencyHistogram {
+private:
+    static constexpr int kSubBucketBits = 7;
+    static constexpr uint64_t kSubBucketCount = 1ULL << kSubBucketBits;
+    static constexpr int kBucketCount = 64 - kSubBucketBits;
+
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+    uint64_t max_value = 0;
+    long double sum = 0;
+
+    static size_t indexOf(uint64_t value) {
+        if (value < kSubBucketCount) {
+            return static_cast<size_t>(value);
+        }
+        int msb = 63 - __builtin_clzll(value);
+        int shift = msb - kSubBucketBits;
+        return static_cast<size_t>((shift + 1) * kSubBucketCount + ((value >> shift) - kSubBucketCount));
+    }
+
+    // Highest value that maps into the bucket at index
+    static uint64_t highestEquivalent(size_t index) {
+        if (index < kSubBucketCount) {
+            return index;
+        }
+        int shift = static_cast<int>(index / kSubBucketCount) - 1;
+        uint64_t lowest = (kSubBucketCount + index % kSubBucketCount) << shift;
+        return lowest + (1ULL << shift) - 1;
+    }
+
+public:
+    LatencyHistogram() : counts(kBucketCount * kSubBucketCount, 0) {}
+
+    void record(uint64_t value) {
+        counts[indexOf(value)]++;
+        total++;
+        sum += value;
+        max_value = std::max(max_value, value);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < counts.size(); ++i) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        sum += other.sum;
+        max_value = std::max(max_value, other.max_value);
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t max() const { return max_value; }
+    double mean() const { return total ? static_cast<double>(sum / total) : 0.0; }
+
+    uint64_t valueAtPercentile(double percentile) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t target = static_cast<uint64_t>(percentile / 100.0 * total + 0.5);
+        target = std::max<uint64_t>(1, std::min(target, total));
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+            if (seen >= target) {
+                return std::min(highestEquivalent(i), max_value);
+            }
+        }
+        return max_value;
+    }
+};
+
+#endif
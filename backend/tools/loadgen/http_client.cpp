@@ -0,0 +1,159 @@
+#include "http_client.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+HttpConnection::HttpConnection(const std::string& host, int port) : host(host), port(port) {}
+
+HttpConnection::~HttpConnection() {
+    closeSocket();
+}
+
+bool HttpConnection::connectSocket() {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* results = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &results) != 0) {
+        return false;
+    }
+
+    for (addrinfo* ai = results; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(results);
+    buffer.clear();
+    return fd >= 0;
+}
+
+void HttpConnection::closeSocket() {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    buffer.clear();
+}
+
+bool HttpConnection::sendAll(const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool HttpConnection::readResponse(HttpResponse& response, bool& keep_alive, bool& received) {
+    char chunk[16384];
+    size_t header_end;
+    received = !buffer.empty();
+    while ((header_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            return false;
+        }
+        received = true;
+        buffer.append(chunk, static_cast<size_t>(n));
+    }
+
+    // Status line: HTTP/1.1 200 OK
+    size_t space = buffer.find(' ');
+    if (space == std::string::npos || space > header_end) {
+        return false;
+    }
+    response.status = std::atoi(buffer.c_str() + space + 1);
+
+    size_t content_length = 0;
+    keep_alive = true;
+    size_t line_start = buffer.find("\r\n") + 2;
+    while (line_start < header_end) {
+        size_t line_end = buffer.find("\r\n", line_start);
+        std::string line = buffer.substr(line_start, line_end - line_start);
+        std::transform(line.begin(), line.end(), line.begin(), [](unsigned char c) { return std::tolower(c); });
+
+        if (line.compare(0, 15, "content-length:") == 0) {
+            content_length = std::strtoul(line.c_str() + 15, nullptr, 10);
+        } else if (line.compare(0, 11, "connection:") == 0 && line.find("close") != std::string::npos) {
+            keep_alive = false;
+        }
+        line_start = line_end + 2;
+    }
+
+    size_t body_start = header_end + 4;
+    while (buffer.size() < body_start + content_length) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            return false;
+        }
+        buffer.append(chunk, static_cast<size_t>(n));
+    }
+
+    response.body = buffer.substr(body_start, content_length);
+    buffer.erase(0, body_start + content_length);
+    return true;
+}
+
+bool HttpConnection::request(const std::string& method, const std::string& path, const std::string& body,
+                             const std::string& token, HttpResponse& response,
+                             const std::string& idempotency_key) {
+    std::string request = method + " " + path + " HTTP/1.1\r\n";
+    request += "Host: " + host + "\r\n";
+    request += "Connection: keep-alive\r\n";
+    if (!token.empty()) {
+        request += "Authorization: " + token + "\r\n";
+    }
+    if (!idempotency_key.empty()) {
+        request += "Idempotency-Key: " + idempotency_key + "\r\n";
+    }
+    if (!body.empty()) {
+        request += "Content-Type: application/json\r\n";
+    }
+    request += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    request += body;
+
+    // A reused keep-alive socket may have been closed by the server while it
+    // sat idle; retry those once on a fresh connection. Once any response
+    // byte has arrived, or if the server may have applied a non-idempotent
+    // request before closing, the failure is reported instead.
+    bool retryable = method == "GET" || method == "HEAD" || !idempotency_key.empty();
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        bool reused = fd >= 0;
+        if (!reused && !connectSocket()) {
+            return false;
+        }
+
+        bool keep_alive = true;
+        bool received = false;
+        if (sendAll(request) && readResponse(response, keep_alive, received)) {
+            if (!keep_alive) {
+                closeSocket();
+            }
+            return true;
+        }
+        closeSocket();
+        if (!reused || received || !retryable) {
+            break;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,41 @@
+#ifndef LOADGEN_HTTP_CLIENT_H
+#define LOADGEN_HTTP_CLIENT_H
+
+#include <string>
+
+struct HttpResponse {
+    int status = 0;
+    std::string body;
+};
+
+// Minimal blocking HTTP/1.1 client holding one keep-alive connection.
+// Requests reconnect transparently when the server closed an idle socket
+// before reading them: only when no response bytes came back, and only for
+// safe methods or requests carrying an Idempotency-Key, so a request the
+// server may already have applied is never sent twice.
+class HttpConnection {
+private:
+    std::string host;
+    int port;
+    int fd = -1;
+    std::string buffer;
+
+    bool connectSocket();
+    void closeSocket();
+    bool sendAll(const std::string& data);
+    bool readResponse(HttpResponse& response, bool& keep_alive, bool& received);
+
+public:
+    HttpConnection(const std::string& host, int port);
+    ~HttpConnection();
+
+    HttpConnection(const HttpConnection&) = delete;
+    HttpConnection& operator=(const HttpConnection&) = delete;
+
+    // Returns false on a transport error; HTTP errors are reported via status
+    bool request(const std::string& method, const std::string& path, const std::string& body,
+                 const std::string& token, HttpResponse& response,
+                 const std::string& idempotency_key = "");
+};
+
+#endif
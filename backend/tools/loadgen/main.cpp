@@ -0,0 +1,419 @@
+#include <crow.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "histogram.h"
+#include "http_client.h"
+#include "memory_database.h"
+#include "routes.h"
+
+// Open-loop HTTP load generator for the banking API.
+//
+// Requests are scheduled at fixed intervals derived from --rate and latency
+// is measured from each request's scheduled send time, not from when a
+// connection became free to send it. A stalled server therefore shows up as
+// queueing delay in the percentiles instead of silently lowering the offered
+// load (coordinated omission).
+
+using Clock = std::chrono::steady_clock;
+
+enum Operation { OP_BALANCE, OP_TRANSFER, OP_TRANSACTIONS, OP_ACCOUNTS, OP_COUNT };
+
+static const char* operationNames[OP_COUNT] = {"balance", "transfer", "transactions", "accounts"};
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    bool stub = false;
+    int stub_threads = 4;
+    int users = 100;
+    int connections = 64;
+    double rate = 1000;
+    double duration = 30;
+    double warmup = 5;
+    unsigned seed = 42;
+    int mix[OP_COUNT] = {40, 20, 20, 20};
+};
+
+struct SyntheticUser {
+    std::string username;
+    std::string token;
+    std::string account_id;
+    std::string account_number;
+};
+
+struct OperationStats {
+    LatencyHistogram latency;
+    LatencyHistogram service_time;
+    uint64_t errors = 0;
+
+    void merge(const OperationStats& other) {
+        latency.merge(other.latency);
+        service_time.merge(other.service_time);
+        errors += other.errors;
+    }
+};
+
+static void printUsage() {
+    std::cout << "Usage: banking_loadgen [options]\n"
+              << "  --host <host>          server host (default 127.0.0.1)\n"
+              << "  --port <port>          server port (default 8080)\n"
+              << "  --stub                 start an in-process server backed by an in-memory database\n"
+              << "  --stub-threads <n>     Crow worker threads for --stub (default 4)\n"
+              << "  --users <n>            synthetic users to register (default 100)\n"
+              << "  --connections <n>      concurrent keep-alive connections (default 64)\n"
+              << "  --rate <req/s>         target request rate (default 1000)\n"
+              << "  --duration <s>         measured duration in seconds (default 30)\n"
+              << "  --warmup <s>           unmeasured warmup before the run (default 5)\n"
+              << "  --mix <spec>           weights, e.g. balance=40,transfer=20,transactions=20,accounts=20\n"
+              << "  --seed <n>             random seed (default 42)\n";
+}
+
+static bool parseMix(const std::string& spec, int mix[OP_COUNT]) {
+    for (int op = 0; op < OP_COUNT; ++op) {
+        mix[op] = 0;
+    }
+
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) {
+            return false;
+        }
+        std::string name = item.substr(0, eq);
+        int weight = std::atoi(item.c_str() + eq + 1);
+
+        bool known = false;
+        for (int op = 0; op < OP_COUNT; ++op) {
+            if (name == operationNames[op]) {
+                mix[op] = weight;
+                known = true;
+            }
+        }
+        if (!known || weight < 0) {
+            return false;
+        }
+    }
+
+    int total = 0;
+    for (int op = 0; op < OP_COUNT; ++op) {
+        total += mix[op];
+    }
+    return total > 0;
+}
+
+static bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> const char* { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char* value = nullptr;
+
+        if (arg == "--stub") {
+            options.stub = true;
+        } else if (arg == "--help" || arg == "-h") {
+            return false;
+        } else if ((value = next()) == nullptr) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        } else if (arg == "--host") {
+            options.host = value;
+        } else if (arg == "--port") {
+            options.port = std::atoi(value);
+        } else if (arg == "--stub-threads") {
+            options.stub_threads = std::atoi(value);
+        } else if (arg == "--users") {
+            options.users = std::atoi(value);
+        } else if (arg == "--connections") {
+            options.connections = std::atoi(value);
+        } else if (arg == "--rate") {
+            options.rate = std::atof(value);
+        } else if (arg == "--duration") {
+            options.duration = std::atof(value);
+        } else if (arg == "--warmup") {
+            options.warmup = std::atof(value);
+        } else if (arg == "--seed") {
+            options.seed = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+        } else if (arg == "--mix") {
+            if (!parseMix(value, options.mix)) {
+                std::cerr << "Invalid --mix: " << value << std::endl;
+                return false;
+            }
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+
+    return options.users >= 2 && options.connections > 0 && options.rate > 0 && options.duration > 0;
+}
+
+// Random per request, so keys never collide with an earlier run's keys,
+// which the server remembers for 24 hours
+static std::string newIdempotencyKey() {
+    thread_local std::mt19937_64 rng(std::random_device{}());
+    char key[40];
+    std::snprintf(key, sizeof(key), "loadgen-%016llx%016llx",
+                  static_cast<unsigned long long>(rng()), static_cast<unsigned long long>(rng()));
+    return key;
+}
+
+// Registers, logs in and opens one funded account for a synthetic user
+static bool setupUser(HttpConnection& conn, SyntheticUser& user) {
+    HttpResponse res;
+    std::string credentials = "{\"username\":\"" + user.username + "\",\"password\":\"loadgen-password\"";
+
+    if (!conn.request("POST", "/api/register", credentials + ",\"email\":\"" + user.username + "@loadgen.test\"}", "", res) ||
+        (res.status != 201 && res.status != 409)) {
+        return false;
+    }
+
+    if (!conn.request("POST", "/api/login", credentials + "}", "", res) || res.status != 200) {
+        return false;
+    }
+    auto login = crow::json::load(res.body);
+    if (!login || !login.has("token")) {
+        return false;
+    }
+    user.token = login["token"].s();
+
+    std::string account_body = "{\"account_type\":\"checking\",\"initial_deposit\":100000}";
+    if (!conn.request("POST", "/api/accounts", account_body, user.token, res, newIdempotencyKey()) ||
+        res.status != 201) {
+        return false;
+    }
+    auto created = crow::json::load(res.body);
+    if (!created || !created.has("account_number")) {
+        return false;
+    }
+    user.account_number = created["account_number"].s();
+
+    if (!conn.request("GET", "/api/accounts", "", user.token, res) || res.status != 200) {
+        return false;
+    }
+    auto accounts = crow::json::load(res.body);
+    if (!accounts) {
+        return false;
+    }
+    for (size_t i = 0; i < accounts.size(); ++i) {
+        if (std::string(accounts[i]["account_number"].s()) == user.account_number) {
+            user.account_id = accounts[i]["id"].s();
+        }
+    }
+    return !user.account_id.empty();
+}
+
+static bool setupUsers(const Options& options, std::vector<SyntheticUser>& users) {
+    // Unique per run so repeated runs against the same mongod don't collide
+    std::string run_id = std::to_string(std::chrono::system_clock::now().time_since_epoch().count() % 1000000000);
+    users.resize(static_cast<size_t>(options.users));
+    for (size_t i = 0; i < users.size(); ++i) {
+        users[i].username = "loadgen_" + run_id + "_" + std::to_string(i);
+    }
+
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> failures{0};
+    std::vector<std::thread> threads;
+    int thread_count = std::min(options.connections, options.users);
+    for (int t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&]() {
+            HttpConnection conn(options.host, options.port);
+            for (size_t i = next++; i < users.size(); i = next++) {
+                if (!setupUser(conn, users[i])) {
+                    failures++;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (failures > 0) {
+        std::cerr << failures << " of " << users.size() << " synthetic users failed to set up" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool issueRequest(HttpConnection& conn, Operation op, const SyntheticUser& user,
+                         const SyntheticUser& counterparty, HttpResponse& res) {
+    switch (op) {
+        case OP_BALANCE:
+            return conn.request("GET", "/api/balance/" + user.account_id, "", user.token, res);
+        case OP_TRANSFER:
+            return conn.request("POST", "/api/transfer",
+                                "{\"from_account\":\"" + user.account_id + "\",\"to_account_number\":\"" +
+                                counterparty.account_number + "\",\"amount\":1.0,\"description\":\"loadgen\"}",
+                                user.token, res, newIdempotencyKey());
+        case OP_TRANSACTIONS:
+            return conn.request("GET", "/api/transactions/" + user.account_id, "", user.token, res);
+        case OP_ACCOUNTS:
+        default:
+            return conn.request("GET", "/api/accounts", "", user.token, res);
+    }
+}
+
+static void printRow(const char* name, const OperationStats& stats, double seconds) {
+    const LatencyHistogram& h = stats.latency;
+    auto ms = [](uint64_t ns) { return ns / 1e6; };
+    std::printf("%-14s %10llu %9.1f %8llu %9.3f %9.3f %9.3f %9.3f %9.3f\n", name,
+                static_cast<unsigned long long>(h.count()), h.count() / seconds,
+                static_cast<unsigned long long>(stats.errors), ms(h.valueAtPercentile(50)),
+                ms(h.valueAtPercentile(90)), ms(h.valueAtPercentile(99)), ms(h.valueAtPercentile(99.9)),
+                ms(h.max()));
+}
+
+static int runLoad(const Options& options, const std::vector<SyntheticUser>& users) {
+    int mix_total = 0;
+    for (int op = 0; op < OP_COUNT; ++op) {
+        mix_total += options.mix[op];
+    }
+
+    auto interval = std::chrono::duration<double, std::nano>(1e9 / options.rate);
+    uint64_t warmup_requests = static_cast<uint64_t>(options.warmup * options.rate);
+    uint64_t total_requests = warmup_requests + static_cast<uint64_t>(options.duration * options.rate);
+
+    auto start = Clock::now() + std::chrono::milliseconds(100);
+    auto measure_start = start + std::chrono::duration_cast<Clock::duration>(interval * warmup_requests);
+    std::atomic<uint64_t> next{0};
+    std::vector<std::vector<OperationStats>> per_thread(static_cast<size_t>(options.connections),
+                                                        std::vector<OperationStats>(OP_COUNT));
+    std::vector<Clock::time_point> finished(static_cast<size_t>(options.connections), start);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < options.connections; ++t) {
+        threads.emplace_back([&, t]() {
+            HttpConnection conn(options.host, options.port);
+            std::mt19937_64 rng(options.seed * 7919 + static_cast<unsigned>(t));
+            HttpResponse res;
+
+            for (uint64_t k = next++; k < total_requests; k = next++) {
+                auto intended = start + std::chrono::duration_cast<Clock::duration>(interval * k);
+                std::this_thread::sleep_until(intended);
+
+                int pick = static_cast<int>(rng() % static_cast<uint64_t>(mix_total));
+                int op = 0;
+                while (pick >= options.mix[op]) {
+                    pick -= options.mix[op++];
+                }
+                // Counterparty is always a different user; self-transfers aren't realistic traffic
+                size_t from = rng() % users.size();
+                size_t to = (from + 1 + rng() % (users.size() - 1)) % users.size();
+                const SyntheticUser& user = users[from];
+                const SyntheticUser& counterparty = users[to];
+
+                auto sent = Clock::now();
+                bool ok = issueRequest(conn, static_cast<Operation>(op), user, counterparty, res);
+                auto done = Clock::now();
+
+                if (k < warmup_requests) {
+                    continue;
+                }
+                OperationStats& stats = per_thread[t][op];
+                stats.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(done - intended).count());
+                stats.service_time.record(std::chrono::duration_cast<std::chrono::nanoseconds>(done - sent).count());
+                if (!ok || res.status >= 400) {
+                    stats.errors++;
+                }
+                finished[t] = done;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::vector<OperationStats> totals(OP_COUNT);
+    OperationStats overall;
+    Clock::time_point last = measure_start;
+    for (int t = 0; t < options.connections; ++t) {
+        for (int op = 0; op < OP_COUNT; ++op) {
+            totals[op].merge(per_thread[t][op]);
+            overall.merge(per_thread[t][op]);
+        }
+        last = std::max(last, finished[t]);
+    }
+    double seconds = std::chrono::duration<double>(last - measure_start).count();
+    if (seconds <= 0) {
+        seconds = options.duration;
+    }
+
+    std::printf("\nTarget rate %.0f req/s over %.0f s with %d connections, %d users\n",
+                options.rate, options.duration, options.connections, options.users);
+    std::printf("Latency is measured from the scheduled send time (ms)\n\n");
+    std::printf("%-14s %10s %9s %8s %9s %9s %9s %9s %9s\n", "operation", "requests", "req/s", "errors",
+                "p50", "p90", "p99", "p99.9", "max");
+    for (int op = 0; op < OP_COUNT; ++op) {
+        if (options.mix[op] > 0) {
+            printRow(operationNames[op], totals[op], seconds);
+        }
+    }
+    printRow("all", overall, seconds);
+
+    std::printf("\nService time (ms, excludes queueing): p50 %.3f  p99 %.3f  p99.9 %.3f\n",
+                overall.service_time.valueAtPercentile(50) / 1e6, overall.service_time.valueAtPercentile(99) / 1e6,
+                overall.service_time.valueAtPercentile(99.9) / 1e6);
+
+    double achieved = overall.latency.count() / seconds;
+    if (achieved < options.rate * 0.95) {
+        std::printf("Achieved %.0f req/s, below the %.0f req/s target: the server (or --connections) is saturated\n",
+                    achieved, options.rate);
+    }
+    return overall.errors > 0 ? 1 : 0;
+}
+
+// In-process server so the generator runs without a mongod. It has no
+// velocity engine, so its transfers are never rate limited.
+struct StubServer {
+    MemoryDatabase database;
+    Routes routes{&database};
+    BankingApp app;
+    std::future<void> running;
+};
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 2;
+    }
+
+    std::unique_ptr<StubServer> stub;
+    if (options.stub) {
+        options.host = "127.0.0.1";
+        stub = std::make_unique<StubServer>();
+        stub->routes.setupRoutes(stub->app);
+        stub->app.loglevel(crow::LogLevel::Warning);
+        stub->running = stub->app.bindaddr(options.host).port(static_cast<uint16_t>(options.port))
+                            .concurrency(static_cast<uint16_t>(options.stub_threads)).run_async();
+        stub->app.wait_for_server_start();
+        std::cout << "In-process stub server listening on port " << options.port << std::endl;
+    }
+
+    std::vector<SyntheticUser> users;
+    std::cout << "Setting up " << options.users << " synthetic users..." << std::endl;
+    if (!setupUsers(options, users)) {
+        if (stub) {
+            stub->app.stop();
+        }
+        return 1;
+    }
+
+    std::cout << "Running for " << options.warmup << " s warmup + " << options.duration << " s..." << std::endl;
+    int status = runLoad(options, users);
+
+    if (stub) {
+        stub->app.stop();
+    }
+    return status;
+}
@@ -0,0 +1,127 @@
+#include <mongocxx/instance.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "database.h"
+#include "rollups.h"
+
+// Recomputes every account's day and month rollups from the transactions
+// collection. Run it after enabling rollups on an existing database, or to
+// repair rollups that drifted (e.g. a crash between a transfer and its
+// rollup upsert). Run it while transfers are paused: a live upsert that
+// lands between an account's recompute and its replace is overwritten.
+//
+// Usage: banking_rollup_rebuild [--threads N]
+
+// Bounded hand-off from the account cursor to the rebuild workers, so memory
+// stays flat no matter how many accounts there are
+class AccountQueue {
+private:
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::deque<Account> items;
+    size_t capacity;
+    bool closed = false;
+
+public:
+    explicit AccountQueue(size_t capacity) : capacity(capacity) {}
+
+    void push(const Account& account) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this] { return items.size() < capacity; });
+        items.push_back(account);
+        not_empty.notify_one();
+    }
+
+    bool pop(Account& account) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this] { return !items.empty() || closed; });
+        if (items.empty()) {
+            return false;
+        }
+        account = items.front();
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+    }
+};
+
+int main(int argc, char** argv) {
+    unsigned threads = std::thread::hardware_concurrency();
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            threads = static_cast<unsigned>(std::atoi(argv[++i]));
+        } else {
+            std::cerr << "Usage: banking_rollup_rebuild [--threads N]" << std::endl;
+            return 2;
+        }
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    mongocxx::instance inst{};
+    auto start = std::chrono::steady_clock::now();
+
+    AccountQueue queue(threads * 64);
+    std::atomic<size_t> rebuilt{0};
+    std::atomic<size_t> failed{0};
+    std::atomic<size_t> periods{0};
+
+    // Database hands each call its own client from its pool, so the workers
+    // and the account cursor share one
+    Database db;
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&]() {
+            Account account;
+            while (queue.pop(account)) {
+                std::vector<Transaction> transactions = db.getTransactionsByAccountId(account.id);
+                std::vector<AccountRollup> rollups = Rollups::compute(account.id, transactions, account.balance);
+
+                if (db.replaceAccountRollups(account.id, rollups)) {
+                    periods += rollups.size();
+                    if (++rebuilt % 10000 == 0) {
+                        std::cout << "Rebuilt " << rebuilt << " accounts..." << std::endl;
+                    }
+                } else {
+                    failed++;
+                }
+            }
+        });
+    }
+
+    db.forEachAccount([&](const Account& account) {
+        queue.push(account);
+    });
+    queue.close();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Rebuilt rollups for " << rebuilt << " accounts (" << periods << " periods) in "
+              << seconds << " s with " << threads << " threads";
+    if (failed > 0) {
+        std::cout << ", " << failed << " accounts failed";
+    }
+    std::cout << std::endl;
+
+    return failed > 0 ? 1 : 0;
+}
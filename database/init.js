@@ -19,6 +19,30 @@ db.transactions.createIndex({ "from_account": 1 });
 db.transactions.createIndex({ "to_account": 1 });
 db.transactions.createIndex({ "timestamp": -1 });
 
+// Create per-account daily/monthly rollups collection
+db.createCollection("account_rollups");
+db.account_rollups.createIndex({ "account_id": 1, "granularity": 1, "period": 1 }, { unique: true });
+
+// Create Idempotency-Key response store; documents expire 24 hours after creation
+db.createCollection("idempotency_keys");
+db.idempotency_keys.createIndex({ "key": 1 }, { unique: true });
+db.idempotency_keys.createIndex({ "created_at": 1 }, { expireAfterSeconds: 86400 });
+
+// Batch job checkpoints, plus indexes that let accrual reruns find the
+// transactions they already wrote
+db.createCollection("batch_checkpoints");
+db.transactions.createIndex(
+    { "batch_run": 1, "to_account": 1 },
+    { partialFilterExpression: { "batch_run": { $exists: true } } }
+);
+db.transactions.createIndex(
+    { "batch_run": 1, "from_account": 1 },
+    { partialFilterExpression: { "batch_run": { $exists: true } } }
+);
+
+// Reconciliation watermarks (incremental runs start from the last cutoff)
+db.createCollection("recon_watermarks");
+
 // Insert sample data for testing
 db.users.insertOne({
     username: "testuser",